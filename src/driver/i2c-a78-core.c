@@ -9,21 +9,58 @@
 #include <linux/clk.h>
 #include <linux/io.h>
 #include <linux/delay.h>
+#include <linux/iopoll.h>
 #include <linux/slab.h>
 #include <linux/pm_runtime.h>
 #include <linux/debugfs.h>
 
 #include "../include/i2c-a78.h"
 
-static void i2c_a78_hw_init(struct i2c_a78_dev *i2c_dev)
+static const struct i2c_a78_variant i2c_a78_variant_default = {
+	.fifo_size = I2C_A78_FIFO_SIZE,
+	.tx_burst = I2C_A78_DMA_BURST,
+	.rx_burst = I2C_A78_DMA_BURST,
+	.resume_settle_us = -1,
+};
+
+static void i2c_a78_init_timings(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_timings *t = &i2c_dev->timings;
+	const struct i2c_a78_scl_spec *spec;
+	
+	t->bus_freq_hz = i2c_dev->bus_freq;
+	i2c_parse_fw_timings(i2c_dev->dev, t, false);
+	
+	spec = i2c_a78_scl_spec(i2c_dev->bus_freq);
+	if (!t->scl_rise_ns)
+		t->scl_rise_ns = spec->rise_ns;
+	if (!t->scl_fall_ns)
+		t->scl_fall_ns = spec->fall_ns;
+	if (!t->sda_fall_ns)
+		t->sda_fall_ns = t->scl_fall_ns;
+	
+	if (of_property_read_u32(i2c_dev->dev->of_node, "i2c-bus-free-time-ns",
+				 &i2c_dev->bus_free_ns))
+		i2c_dev->bus_free_ns = spec->buf_ns;
+}
+
+static int i2c_a78_prescaler(struct i2c_a78_dev *i2c_dev, unsigned long clk_rate,
+			     u32 *prescaler)
+{
+	return i2c_a78_scl_calc(&i2c_dev->timings, i2c_dev->bus_free_ns, clk_rate,
+				prescaler, &i2c_dev->bus_freq_actual);
+}
+
+static int i2c_a78_hw_init(struct i2c_a78_dev *i2c_dev)
 {
 	u32 prescaler, control;
-	unsigned long clk_rate;
+	int ret;
 	
-	clk_rate = clk_get_rate(i2c_dev->clk);
-	prescaler = clk_rate / (i2c_dev->bus_freq * 5) - 1;
+	ret = i2c_a78_prescaler(i2c_dev, clk_get_rate(i2c_dev->clk), &prescaler);
+	if (ret)
+		return ret;
 	
-	i2c_a78_writel(i2c_dev, prescaler, I2C_A78_PRESCALER);
+	i2c_a78_write_ctx(i2c_dev, prescaler, I2C_A78_PRESCALER);
 	
 	control = I2C_A78_CONTROL_MASTER_EN | I2C_A78_CONTROL_INT_EN;
 	
@@ -45,16 +82,15 @@ static void i2c_a78_hw_init(struct i2c_a78_dev *i2c_dev)
 		break;
 	}
 	
-	if (i2c_dev->dma.use_dma) {
-		control |= I2C_A78_CONTROL_DMA_TX_EN | I2C_A78_CONTROL_DMA_RX_EN;
-	}
-	
-	i2c_a78_writel(i2c_dev, control, I2C_A78_CONTROL);
+	i2c_a78_write_ctx(i2c_dev, control, I2C_A78_CONTROL);
 	
-	i2c_a78_writel(i2c_dev, I2C_A78_CONTROL_FIFO_TX_CLR | I2C_A78_CONTROL_FIFO_RX_CLR,
-		       I2C_A78_CONTROL);
+	/* The FIFO clear bits are self-clearing and not part of the context */
+	i2c_a78_writel(i2c_dev, control | I2C_A78_CONTROL_FIFO_TX_CLR |
+		       I2C_A78_CONTROL_FIFO_RX_CLR, I2C_A78_CONTROL);
 	
 	i2c_a78_writel(i2c_dev, 0xFF, I2C_A78_INTERRUPT);
+	
+	return 0;
 }
 
 static int i2c_a78_wait_for_completion(struct i2c_a78_dev *i2c_dev)
@@ -72,6 +108,17 @@ static int i2c_a78_wait_for_completion(struct i2c_a78_dev *i2c_dev)
 	return 0;
 }
 
+/*
+ * Prepare msg_complete for the next message. The transfer thread is woken
+ * once every event in @mask has been signalled (or on a bus error).
+ */
+static void i2c_a78_arm_events(struct i2c_a78_dev *i2c_dev, u32 mask)
+{
+	reinit_completion(&i2c_dev->msg_complete);
+	atomic_set(&i2c_dev->events, 0);
+	WRITE_ONCE(i2c_dev->event_mask, mask);
+}
+
 static int i2c_a78_send_address(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
 {
 	u32 addr = msg->addr;
@@ -94,6 +141,63 @@ static int i2c_a78_send_address(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg
 	return 0;
 }
 
+/*
+ * Start the DMA message staged during the one that just completed,
+ * straight from the completion path, so the bus does not sit idle until
+ * the transfer thread has been scheduled. Called with i2c_dev->lock held.
+ */
+static void i2c_a78_issue_ahead(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_msg *msg = i2c_dev->dma.next->msgs;
+	
+	atomic_set(&i2c_dev->events, 0);
+	
+	if (i2c_a78_dma_issue_next(i2c_dev))
+		return;
+	
+	i2c_dev->msg_idx++;
+	i2c_dev->batch_end = i2c_dev->msg_idx + 1;
+	i2c_dev->state = I2C_A78_STATE_START;
+	i2c_dev->dma.issued_ahead = true;
+	
+	i2c_a78_send_address(i2c_dev, msg);
+}
+
+/**
+ * i2c_a78_signal_event - Record a completion event for the current message
+ * @i2c_dev: I2C device structure
+ * @event: I2C_A78_EVENT_* bit that has been observed
+ *
+ * Wakes the transfer thread once every event in event_mask has been seen,
+ * whichever of the DMA callback and the controller interrupt arrives last.
+ * A DMA message staged in the meantime is issued before the wakeup.
+ */
+void i2c_a78_signal_event(struct i2c_a78_dev *i2c_dev, u32 event)
+{
+	unsigned long flags;
+	u32 mask, old;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	
+	mask = i2c_dev->event_mask;
+	old = atomic_fetch_or(event, &i2c_dev->events);
+	if (!i2c_a78_events_complete(mask, old, event)) {
+		spin_unlock_irqrestore(&i2c_dev->lock, flags);
+		return;
+	}
+	
+	if (mask & I2C_A78_EVENT_DMA_DONE) {
+		i2c_dev->dma.active->ok = true;
+		
+		if (i2c_dev->dma.next)
+			i2c_a78_issue_ahead(i2c_dev);
+	}
+	
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	complete(&i2c_dev->msg_complete);
+}
+
 static int i2c_a78_pio_write(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
 {
 	int i;
@@ -133,24 +237,166 @@ static int i2c_a78_pio_read(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
 	return 0;
 }
 
-static int i2c_a78_xfer_msg(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
+/*
+ * Wait for the DMA message on the bus, staging @next in the idle half of
+ * the bounce buffer first so it can be issued from the completion path.
+ */
+static int i2c_a78_wait_dma(struct i2c_a78_dev *i2c_dev, struct i2c_msg *next)
 {
 	int ret;
 	
-	reinit_completion(&i2c_dev->msg_complete);
+	if (next)
+		i2c_a78_dma_prepare_next(i2c_dev, next);
+	
+	ret = i2c_a78_wait_for_completion(i2c_dev);
+	return i2c_a78_dma_finish(i2c_dev, ret);
+}
+
+/*
+ * With a coherent DMA engine, client buffers are mapped in place and a
+ * single DMA message goes down the scatter-gather path as a one-entry
+ * batch instead of through the bounce buffer.
+ */
+static bool i2c_a78_dma_zero_copy(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
+{
+	return i2c_dev->dma.coherent && i2c_dev->dma.xfer_dma &&
+	       i2c_a78_dma_wanted(i2c_dev, msg);
+}
+
+/*
+ * A DMA message is completed by polling when it is short enough on the
+ * bus that waking a sleeping thread would cost more than the transfer
+ * itself. A bounced message must also fit the buffer in one chunk; one
+ * mapped in place has no such limit.
+ */
+static bool i2c_a78_dma_pollable(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
+{
+	if (!i2c_a78_dma_zero_copy(i2c_dev, msg) && msg->len > i2c_dev->dma.buf_len)
+		return false;
+	
+	return i2c_a78_dma_poll_fits(msg->len, i2c_dev->bus_freq, i2c_dev->dma_poll_us);
+}
+
+#define I2C_A78_INT_ERRORS \
+	(I2C_A78_INT_ARB_LOST | I2C_A78_INT_NACK | I2C_A78_INT_TIMEOUT)
+
+static bool i2c_a78_poll_done(struct i2c_a78_dev *i2c_dev, u32 *int_status)
+{
+	*int_status = i2c_a78_readl(i2c_dev, I2C_A78_INTERRUPT);
+	
+	if (*int_status & I2C_A78_INT_ERRORS)
+		return true;
+	
+	if (!(*int_status & (I2C_A78_INT_TX_DONE | I2C_A78_INT_RX_READY)))
+		return false;
+	
+	return i2c_a78_dma_polled_done(i2c_dev);
+}
+
+/*
+ * Run a short DMA message with the controller interrupt masked, spinning
+ * on the DMA cookie and the interrupt status for up to twice the poll
+ * budget before falling back to sleeping between polls.
+ */
+static int i2c_a78_xfer_polled(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
+{
+	u32 control, int_status = 0;
+	ktime_t spin_end;
+	bool done;
+	int ret;
+	
+	control = i2c_a78_read_ctx(i2c_dev, I2C_A78_CONTROL);
+	i2c_a78_write_ctx(i2c_dev, control & ~I2C_A78_CONTROL_INT_EN, I2C_A78_CONTROL);
+	
+	ret = i2c_a78_send_address(i2c_dev, msg);
+	if (ret)
+		goto out;
+	
+	if (i2c_a78_dma_zero_copy(i2c_dev, msg))
+		ret = i2c_a78_dma_xfer_sg(i2c_dev, msg, 1, true);
+	else
+		ret = i2c_a78_dma_xfer(i2c_dev, msg, true);
+	if (ret)
+		goto out;
+	
+	spin_end = ktime_add_us(ktime_get(), 2 * i2c_dev->dma_poll_us);
+	do {
+		done = i2c_a78_poll_done(i2c_dev, &int_status);
+		if (done)
+			break;
+		cpu_relax();
+	} while (ktime_before(ktime_get(), spin_end));
+	
+	if (!done) {
+		i2c_dev->stats.dma_poll_sleeps++;
+		ret = read_poll_timeout(i2c_a78_poll_done, done, done, 20,
+					i2c_dev->timeout_ms * USEC_PER_MSEC, false,
+					i2c_dev, &int_status);
+		if (ret) {
+			dev_err(i2c_dev->dev, "Transfer timeout\n");
+			i2c_dev->stats.timeouts++;
+		}
+	}
+	
+	if (int_status & I2C_A78_INT_ARB_LOST) {
+		dev_err(i2c_dev->dev, "Arbitration lost\n");
+		i2c_dev->stats.arb_lost++;
+	}
+	if (int_status & I2C_A78_INT_NACK) {
+		dev_dbg(i2c_dev->dev, "NACK received\n");
+		i2c_dev->stats.nacks++;
+	}
+	if (int_status & I2C_A78_INT_TIMEOUT) {
+		dev_err(i2c_dev->dev, "Transfer timeout in polled DMA\n");
+		i2c_dev->stats.timeouts++;
+	}
+	
+	i2c_dev->dma.active->ok = !ret && !(int_status & I2C_A78_INT_ERRORS);
+	ret = i2c_a78_dma_finish(i2c_dev, ret);
+	if (!ret)
+		i2c_dev->stats.dma_polled++;
+	
+out:
+	i2c_a78_writel(i2c_dev, int_status, I2C_A78_INTERRUPT);
+	i2c_a78_write_ctx(i2c_dev, control, I2C_A78_CONTROL);
+	return ret;
+}
+
+static int i2c_a78_xfer_msg(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg,
+			    struct i2c_msg *next)
+{
+	bool use_dma = i2c_dev->dma.xfer_dma && i2c_a78_dma_wanted(i2c_dev, msg);
+	int ret;
+	
+	if (i2c_dev->dma.issued_ahead) {
+		/* Already started from the previous message's completion path */
+		i2c_dev->dma.issued_ahead = false;
+		return i2c_a78_wait_dma(i2c_dev, next);
+	}
+	
+	if (use_dma && !next && i2c_a78_dma_pollable(i2c_dev, msg))
+		return i2c_a78_xfer_polled(i2c_dev, msg);
+	
+	i2c_a78_arm_events(i2c_dev, use_dma ?
+			   I2C_A78_EVENT_CTRL_DONE | I2C_A78_EVENT_DMA_DONE :
+			   I2C_A78_EVENT_CTRL_DONE);
 	
 	ret = i2c_a78_send_address(i2c_dev, msg);
 	if (ret)
 		return ret;
 	
-	if (i2c_dev->dma.use_dma && msg->len >= I2C_A78_DMA_THRESHOLD) {
-		ret = i2c_a78_dma_xfer(i2c_dev, msg);
+	if (use_dma) {
+		ret = i2c_a78_dma_xfer(i2c_dev, msg, false);
+		if (ret)
+			return ret;
+		
+		return i2c_a78_wait_dma(i2c_dev, next);
+	}
+	
+	if (msg->flags & I2C_M_RD) {
+		ret = i2c_a78_pio_read(i2c_dev, msg);
 	} else {
-		if (msg->flags & I2C_M_RD) {
-			ret = i2c_a78_pio_read(i2c_dev, msg);
-		} else {
-			ret = i2c_a78_pio_write(i2c_dev, msg);
-		}
+		ret = i2c_a78_pio_write(i2c_dev, msg);
 	}
 	
 	if (ret)
@@ -159,40 +405,165 @@ static int i2c_a78_xfer_msg(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
 	return i2c_a78_wait_for_completion(i2c_dev);
 }
 
-static int i2c_a78_master_xfer(struct i2c_adapter *adapter,
-			       struct i2c_msg msgs[], int num)
+/*
+ * Count the run of DMA-eligible, same-direction messages starting at
+ * @msgs. Runs longer than one message are moved as a single
+ * scatter-gather job; anything else goes through i2c_a78_xfer_msg().
+ */
+static int i2c_a78_dma_batch_len(struct i2c_a78_dev *i2c_dev,
+				 struct i2c_msg *msgs, int num)
 {
-	struct i2c_a78_dev *i2c_dev = i2c_get_adapdata(adapter);
-	unsigned long flags;
-	int ret, i;
+	if (!i2c_dev->dma.xfer_dma)
+		return 1;
+	
+	return i2c_a78_dma_run_len(i2c_dev->dma.threshold, i2c_dev->dma.max_burst,
+				   msgs, num);
+}
+
+static int i2c_a78_xfer_batch(struct i2c_a78_dev *i2c_dev,
+			      struct i2c_msg *msgs, int num)
+{
+	int ret;
+	
+	if (num == 1 && i2c_a78_dma_pollable(i2c_dev, msgs))
+		return i2c_a78_xfer_polled(i2c_dev, msgs);
 	
-	ret = pm_runtime_get_sync(i2c_dev->dev);
-	if (ret < 0) {
-		pm_runtime_put_noidle(i2c_dev->dev);
+	i2c_a78_arm_events(i2c_dev, I2C_A78_EVENT_CTRL_DONE | I2C_A78_EVENT_DMA_DONE);
+	
+	ret = i2c_a78_send_address(i2c_dev, &msgs[0]);
+	if (ret)
 		return ret;
+	
+	ret = i2c_a78_dma_xfer_sg(i2c_dev, msgs, num, false);
+	if (ret)
+		return ret;
+	
+	ret = i2c_a78_wait_for_completion(i2c_dev);
+	return i2c_a78_dma_finish(i2c_dev, ret);
+}
+
+/*
+ * Acquire the DMA channels on the first transfer that can use them and
+ * lease a bounce buffer for this transfer. Returns true if the transfer
+ * may use DMA.
+ */
+static bool i2c_a78_dma_demand(struct i2c_a78_dev *i2c_dev,
+			       struct i2c_msg *msgs, int num)
+{
+	int i, ret;
+	
+	if (!i2c_dev->dma.enabled)
+		return false;
+	
+	for (i = 0; i < num; i++)
+		if (i2c_a78_dma_wanted(i2c_dev, &msgs[i]))
+			break;
+	
+	if (i == num)
+		return false;
+	
+	if (!i2c_dev->dma.use_dma) {
+		ret = i2c_a78_dma_acquire(i2c_dev);
+		if (ret == -EPROBE_DEFER)
+			return false;
+		
+		if (ret) {
+			dev_info(i2c_dev->dev, "DMA not available, using PIO mode\n");
+			i2c_dev->dma.enabled = false;
+			return false;
+		}
 	}
 	
+	/* With no channel pair or pool buffer free, this transfer goes through PIO */
+	return !i2c_a78_dma_lease(i2c_dev);
+}
+
+/*
+ * A transaction marks the bus busy so that a rate change waits for it to
+ * finish, and does not start while one is in progress. Both waits are
+ * bounded by timeout_ms: the notifier runs under the clock framework's
+ * global lock, and a clock provider on this very bus may need a transfer
+ * to complete the change. A transaction still waiting after that fails
+ * with -EAGAIN. Returns with xfer_busy set, or an error.
+ */
+static int i2c_a78_rate_enter(struct i2c_a78_dev *i2c_dev)
+{
+	long left = msecs_to_jiffies(i2c_dev->timeout_ms);
+	unsigned long flags;
+	
 	spin_lock_irqsave(&i2c_dev->lock, flags);
 	
+	while (i2c_dev->rate_changing) {
+		spin_unlock_irqrestore(&i2c_dev->lock, flags);
+		left = wait_event_timeout(i2c_dev->rate_wait,
+					  !READ_ONCE(i2c_dev->rate_changing), left);
+		if (!left)
+			return -EAGAIN;
+		spin_lock_irqsave(&i2c_dev->lock, flags);
+	}
+	
 	if (i2c_dev->suspended) {
 		spin_unlock_irqrestore(&i2c_dev->lock, flags);
-		pm_runtime_put(i2c_dev->dev);
 		return -EBUSY;
 	}
 	
+	i2c_dev->xfer_busy = true;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	return 0;
+}
+
+static void i2c_a78_rate_exit(struct i2c_a78_dev *i2c_dev)
+{
+	unsigned long flags;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	i2c_dev->xfer_busy = false;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	wake_up(&i2c_dev->rate_wait);
+}
+
+/*
+ * Runs one combined transaction. The caller holds the bus lock, a runtime
+ * PM reference and, if any message is to use DMA, a DMA lease. The input
+ * clock rate, and so the prescaler, stays fixed throughout.
+ */
+static int i2c_a78_xfer(struct i2c_a78_dev *i2c_dev, struct i2c_msg msgs[], int num)
+{
+	unsigned long flags;
+	int ret = 0, i, n;
+	
+	ret = i2c_a78_rate_enter(i2c_dev);
+	if (ret)
+		return ret;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
 	i2c_dev->msgs = msgs;
 	i2c_dev->num_msgs = num;
 	i2c_dev->msg_idx = 0;
+	i2c_dev->batch_end = 0;
 	i2c_dev->state = I2C_A78_STATE_START;
 	
 	spin_unlock_irqrestore(&i2c_dev->lock, flags);
 	
-	for (i = 0; i < num; i++) {
-		ret = i2c_a78_xfer_msg(i2c_dev, &msgs[i]);
+	for (i = 0; i < num; i += n) {
+		n = i2c_a78_dma_batch_len(i2c_dev, &msgs[i], num - i);
+		
+		spin_lock_irqsave(&i2c_dev->lock, flags);
+		i2c_dev->msg_idx = i;
+		i2c_dev->batch_end = i + n;
+		spin_unlock_irqrestore(&i2c_dev->lock, flags);
+		
+		if (n > 1 || i2c_a78_dma_zero_copy(i2c_dev, &msgs[i]))
+			ret = i2c_a78_xfer_batch(i2c_dev, &msgs[i], n);
+		else if (i + 1 < num &&
+			 i2c_a78_dma_batch_len(i2c_dev, &msgs[i + 1], num - i - 1) == 1)
+			ret = i2c_a78_xfer_msg(i2c_dev, &msgs[i], &msgs[i + 1]);
+		else
+			ret = i2c_a78_xfer_msg(i2c_dev, &msgs[i], NULL);
 		if (ret)
 			break;
-		
-		i2c_dev->msg_idx++;
 	}
 	
 	if (i2c_dev->num_msgs > 0) {
@@ -202,13 +573,38 @@ static int i2c_a78_master_xfer(struct i2c_adapter *adapter,
 	spin_lock_irqsave(&i2c_dev->lock, flags);
 	i2c_dev->state = I2C_A78_STATE_IDLE;
 	spin_unlock_irqrestore(&i2c_dev->lock, flags);
-	
-	pm_runtime_mark_last_busy(i2c_dev->dev);
-	pm_runtime_put_autosuspend(i2c_dev->dev);
+	i2c_a78_rate_exit(i2c_dev);
 	
 	return ret ? ret : num;
 }
 
+static int i2c_a78_master_xfer(struct i2c_adapter *adapter,
+			       struct i2c_msg msgs[], int num)
+{
+	struct i2c_a78_dev *i2c_dev = i2c_get_adapdata(adapter);
+	bool dma_used;
+	int ret;
+	
+	ret = i2c_a78_pm_get(i2c_dev);
+	if (ret)
+		return ret;
+	
+	dma_used = i2c_a78_dma_demand(i2c_dev, msgs, num);
+	i2c_dev->dma.xfer_dma = dma_used;
+	
+	ret = i2c_a78_xfer(i2c_dev, msgs, num);
+	
+	if (dma_used) {
+		i2c_dev->dma.xfer_dma = false;
+		i2c_dev->dma.last_use = ktime_get();
+		i2c_a78_dma_return(i2c_dev);
+	}
+	
+	i2c_a78_pm_put(i2c_dev);
+	
+	return ret;
+}
+
 static u32 i2c_a78_func(struct i2c_adapter *adapter)
 {
 	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL | I2C_FUNC_10BIT_ADDR;
@@ -219,6 +615,474 @@ static const struct i2c_algorithm i2c_a78_algo = {
 	.functionality = i2c_a78_func,
 };
 
+/**
+ * i2c_a78_stream_open - Start a streaming write transaction
+ * @adapter: I2C adapter of an A78 controller
+ * @addr: Target address
+ * @flags: I2C_M_TEN if @addr is a 10-bit address
+ *
+ * Locks the bus, resumes the controller, leases its DMA resources and
+ * sends a single START and address. Data is then fed with
+ * i2c_a78_stream_write() for as long as needed and the transaction is
+ * ended with i2c_a78_stream_close(). Other clients of the bus block
+ * until then. A change of the input clock rate aborts the stream, which
+ * holds the rate fixed only while it starts and stops. Reads are not
+ * supported, as the controller can only NACK the last byte of a read
+ * whose length it was given up front.
+ *
+ * Returns: the stream, or an ERR_PTR() on failure
+ */
+struct i2c_a78_stream *i2c_a78_stream_open(struct i2c_adapter *adapter,
+					   u16 addr, u16 flags)
+{
+	struct i2c_a78_dev *i2c_dev;
+	struct i2c_a78_stream *stream;
+	unsigned long irqflags;
+	int ret;
+	
+	if (adapter->algo != &i2c_a78_algo)
+		return ERR_PTR(-EINVAL);
+	
+	if (flags & I2C_M_RD)
+		return ERR_PTR(-EOPNOTSUPP);
+	
+	i2c_dev = i2c_get_adapdata(adapter);
+	if (!i2c_dev->dma.enabled)
+		return ERR_PTR(-ENODEV);
+	
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (!stream)
+		return ERR_PTR(-ENOMEM);
+	
+	stream->i2c_dev = i2c_dev;
+	stream->msg.addr = addr;
+	stream->msg.flags = flags & I2C_M_TEN;
+	
+	i2c_lock_bus(adapter, I2C_LOCK_ROOT_ADAPTER);
+	
+	ret = i2c_a78_pm_claim(i2c_dev);
+	if (ret)
+		goto err_unlock;
+	
+	ret = i2c_a78_rate_enter(i2c_dev);
+	if (ret)
+		goto err_pm;
+	
+	ret = i2c_a78_dma_stream_start(stream);
+	if (ret)
+		goto err_rate;
+	
+	spin_lock_irqsave(&i2c_dev->lock, irqflags);
+	i2c_dev->msgs = NULL;
+	i2c_dev->num_msgs = 0;
+	i2c_dev->state = I2C_A78_STATE_START;
+	i2c_dev->stream = stream;
+	spin_unlock_irqrestore(&i2c_dev->lock, irqflags);
+	
+	i2c_a78_send_address(i2c_dev, &stream->msg);
+	
+	i2c_a78_rate_exit(i2c_dev);
+	i2c_dev->stats.streams++;
+	
+	return stream;
+	
+err_rate:
+	i2c_a78_rate_exit(i2c_dev);
+err_pm:
+	i2c_a78_pm_put(i2c_dev);
+err_unlock:
+	i2c_unlock_bus(adapter, I2C_LOCK_ROOT_ADAPTER);
+	kfree(stream);
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(i2c_a78_stream_open);
+
+/**
+ * i2c_a78_stream_close - Finish a streaming write transaction
+ * @stream: Stream returned by i2c_a78_stream_open()
+ *
+ * Waits for the queued segments and for the controller to drain its
+ * FIFO, then sends STOP and releases the bus. After an abort or a
+ * failure the remaining segments are discarded. @stream is freed.
+ *
+ * Returns: 0 if every byte was sent, -ECANCELED after an abort, including
+ * one for a clock rate change, other negative error code on failure
+ */
+int i2c_a78_stream_close(struct i2c_a78_stream *stream)
+{
+	struct i2c_a78_dev *i2c_dev = stream->i2c_dev;
+	unsigned long flags;
+	u32 status;
+	int ret;
+	
+	ret = i2c_a78_dma_stream_stop(stream);
+	
+	/*
+	 * The FIFO drains and STOP goes out before a rate change proceeds.
+	 * Closing must not fail, so it does not wait out a change already in
+	 * progress; that change has aborted the stream and nothing drains.
+	 */
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	i2c_dev->xfer_busy = true;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	if (!ret && READ_ONCE(stream->aborted))
+		ret = -ECANCELED;
+	
+	if (!ret) {
+		ret = readl_relaxed_poll_timeout(i2c_dev->base + I2C_A78_STATUS, status,
+						 status & (I2C_A78_STATUS_TX_DONE |
+							   I2C_A78_STATUS_NACK |
+							   I2C_A78_STATUS_ARB_LOST |
+							   I2C_A78_STATUS_TIMEOUT),
+						 10, i2c_dev->timeout_ms * USEC_PER_MSEC);
+		if (!ret && !(status & I2C_A78_STATUS_TX_DONE))
+			ret = -EIO;
+	}
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	i2c_dev->stream = NULL;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	synchronize_irq(i2c_dev->irq);
+	
+	i2c_a78_writel(i2c_dev, I2C_A78_COMMAND_STOP, I2C_A78_COMMAND);
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	i2c_dev->state = I2C_A78_STATE_IDLE;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	i2c_a78_rate_exit(i2c_dev);
+	
+	if (ret)
+		i2c_dev->stats.stream_aborts++;
+	
+	i2c_dev->dma.last_use = ktime_get();
+	i2c_a78_dma_return(i2c_dev);
+	
+	i2c_a78_pm_put(i2c_dev);
+	i2c_unlock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
+	
+	kfree(stream);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_stream_close);
+
+/*
+ * Return the DMA lease and the runtime PM reference of a session that
+ * ends or expires. The reference is dropped directly: the release worker
+ * would have to wait for the bus lock, which an expired session keeps.
+ * Called with session->lock held.
+ */
+static void i2c_a78_session_release(struct i2c_a78_session *session)
+{
+	struct i2c_a78_dev *i2c_dev = session->i2c_dev;
+	
+	if (session->dma_used) {
+		i2c_dev->dma.xfer_dma = false;
+		i2c_dev->dma.last_use = ktime_get();
+		i2c_a78_dma_return(i2c_dev);
+		session->dma_used = false;
+	}
+	
+	i2c_a78_pm_release(i2c_dev);
+}
+
+/* Called with session->lock held */
+static void i2c_a78_session_expire(struct i2c_a78_session *session)
+{
+	if (session->state != I2C_A78_SESSION_OPEN)
+		return;
+	
+	session->state = i2c_a78_session_expire_state(session->state);
+	session->i2c_dev->stats.session_expired++;
+	i2c_a78_session_release(session);
+}
+
+static void i2c_a78_session_expire_work(struct work_struct *work)
+{
+	struct i2c_a78_session *session = container_of(to_delayed_work(work),
+						       struct i2c_a78_session,
+						       expire_work);
+	
+	mutex_lock(&session->lock);
+	i2c_a78_session_expire(session);
+	mutex_unlock(&session->lock);
+}
+
+/**
+ * i2c_a78_session_begin - Reserve the bus and keep the controller up
+ * @adapter: I2C adapter of an A78 controller
+ *
+ * Locks the bus and takes a runtime PM reference until
+ * i2c_a78_session_end(). Transfers inside the session go through
+ * i2c_a78_session_xfer(), which skips the per-call power, lock and DMA
+ * lease handling of i2c_transfer(). Other clients of the bus block for the
+ * duration, so the session expires once it has been open for
+ * session_max_ms: its runtime PM reference and DMA lease are dropped then,
+ * and the bus is unlocked by its next transfer. Sessions do not nest with
+ * each other or with streams.
+ *
+ * Returns: the session, or an ERR_PTR() on failure
+ */
+struct i2c_a78_session *i2c_a78_session_begin(struct i2c_adapter *adapter)
+{
+	struct i2c_a78_dev *i2c_dev;
+	struct i2c_a78_session *session;
+	int ret;
+	
+	if (adapter->algo != &i2c_a78_algo)
+		return ERR_PTR(-EINVAL);
+	
+	i2c_dev = i2c_get_adapdata(adapter);
+	
+	session = kzalloc(sizeof(*session), GFP_KERNEL);
+	if (!session)
+		return ERR_PTR(-ENOMEM);
+	
+	session->i2c_dev = i2c_dev;
+	mutex_init(&session->lock);
+	INIT_DELAYED_WORK(&session->expire_work, i2c_a78_session_expire_work);
+	
+	i2c_lock_bus(adapter, I2C_LOCK_ROOT_ADAPTER);
+	
+	ret = i2c_a78_pm_claim(i2c_dev);
+	if (ret) {
+		i2c_unlock_bus(adapter, I2C_LOCK_ROOT_ADAPTER);
+		kfree(session);
+		return ERR_PTR(ret);
+	}
+	
+	session->start = ktime_get();
+	session->deadline = ktime_add_ms(session->start, i2c_dev->session_max_ms);
+	session->state = I2C_A78_SESSION_OPEN;
+	i2c_dev->stats.sessions++;
+	
+	schedule_delayed_work(&session->expire_work,
+			      msecs_to_jiffies(i2c_dev->session_max_ms));
+	
+	return session;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_session_begin);
+
+/**
+ * i2c_a78_session_xfer - Run a transfer inside a session
+ * @session: Session returned by i2c_a78_session_begin()
+ * @msgs: Messages to transfer
+ * @num: Number of messages
+ *
+ * The DMA lease taken by the first transfer that wants DMA is kept until
+ * the end of the session. The first call after the session has expired
+ * unlocks the bus.
+ *
+ * Returns: @num on success, -ETIMEDOUT once the session has run past
+ * session_max_ms, -EBUSY while the controller is suspended, other
+ * negative error code on failure
+ */
+int i2c_a78_session_xfer(struct i2c_a78_session *session, struct i2c_msg *msgs,
+			 int num)
+{
+	struct i2c_a78_dev *i2c_dev = session->i2c_dev;
+	int ret;
+	
+	mutex_lock(&session->lock);
+	
+	if (ktime_after(ktime_get(), session->deadline))
+		i2c_a78_session_expire(session);
+	
+	if (session->state != I2C_A78_SESSION_OPEN) {
+		if (i2c_a78_session_holds_bus(session->state))
+			i2c_unlock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
+		session->state = i2c_a78_session_call_state(session->state);
+		ret = -ETIMEDOUT;
+		goto out;
+	}
+	
+	if (i2c_dev->suspended) {
+		ret = -EBUSY;
+		goto out;
+	}
+	
+	if (!session->dma_used) {
+		session->dma_used = i2c_a78_dma_demand(i2c_dev, msgs, num);
+		i2c_dev->dma.xfer_dma = session->dma_used;
+	}
+	
+	session->xfers++;
+	ret = i2c_a78_xfer(i2c_dev, msgs, num);
+	
+out:
+	mutex_unlock(&session->lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_session_xfer);
+
+/**
+ * i2c_a78_session_end - Release the bus at the end of a session
+ * @session: Session returned by i2c_a78_session_begin()
+ *
+ * Returns the DMA lease and the runtime PM reference and unlocks the bus,
+ * as far as expiry has not done so already. @session is freed.
+ */
+void i2c_a78_session_end(struct i2c_a78_session *session)
+{
+	struct i2c_a78_dev *i2c_dev = session->i2c_dev;
+	u32 elapsed;
+	
+	cancel_delayed_work_sync(&session->expire_work);
+	
+	elapsed = ktime_us_delta(ktime_get(), session->start);
+	i2c_dev->stats.session_us += elapsed;
+	i2c_dev->stats.session_max_us = max(i2c_dev->stats.session_max_us, elapsed);
+	i2c_dev->stats.session_xfers += session->xfers;
+	
+	mutex_lock(&session->lock);
+	
+	if (i2c_a78_session_holds_power(session->state))
+		i2c_a78_session_release(session);
+	if (i2c_a78_session_holds_bus(session->state))
+		i2c_unlock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
+	
+	mutex_unlock(&session->lock);
+	mutex_destroy(&session->lock);
+	
+	kfree(session);
+}
+EXPORT_SYMBOL_GPL(i2c_a78_session_end);
+
+/**
+ * i2c_a78_expect_xfer - Hint that a transfer is due
+ * @adapter: I2C adapter of an A78 controller
+ * @when: CLOCK_MONOTONIC time at which the next transfer is expected
+ *
+ * Lets clients that sample periodically hide the resume latency. The
+ * controller is resumed shortly before @when and kept up until the next
+ * transfer, or released again if none comes within a short window. A
+ * later hint replaces an earlier one. Must not be called from hard IRQ
+ * context.
+ *
+ * Returns: 0 on success, -EINVAL if @adapter is not an A78 adapter
+ */
+int i2c_a78_expect_xfer(struct i2c_adapter *adapter, ktime_t when)
+{
+	if (adapter->algo != &i2c_a78_algo)
+		return -EINVAL;
+	
+	i2c_a78_pm_hint(i2c_get_adapdata(adapter), when);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_expect_xfer);
+
+/**
+ * i2c_a78_add_latency_request - Register a resume latency tolerance
+ * @adapter: I2C adapter of an A78 controller
+ * @req: Request to add, removed again with dev_pm_qos_remove_request()
+ * @latency_us: Longest acceptable resume latency in microseconds
+ *
+ * Adds a device PM QoS resume latency request to the controller behind
+ * @adapter. While the tightest request is below the controller's measured
+ * resume cost it is kept runtime active. The limit can be changed later
+ * with dev_pm_qos_update_request().
+ *
+ * Returns: 0 on success, negative error code otherwise
+ */
+int i2c_a78_add_latency_request(struct i2c_adapter *adapter,
+				struct dev_pm_qos_request *req, s32 latency_us)
+{
+	struct i2c_a78_dev *i2c_dev;
+	int ret;
+	
+	if (adapter->algo != &i2c_a78_algo)
+		return -EINVAL;
+	
+	i2c_dev = i2c_get_adapdata(adapter);
+	ret = dev_pm_qos_add_request(i2c_dev->dev, req, DEV_PM_QOS_RESUME_LATENCY,
+				     latency_us);
+	
+	return ret < 0 ? ret : 0;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_add_latency_request);
+
+/*
+ * No lock is held across the notifier calls: they run under the clock
+ * framework's global lock, around other notifiers and the provider's
+ * .set_rate. PRE marks a rate change in progress, which holds new
+ * transactions back, and waits up to timeout_ms for the one on the bus to
+ * finish; if it does not, the change is refused. An open stream is
+ * aborted instead, since its owner decides how long it stays open. POST
+ * writes the prescaler for the new rate under the device lock; a
+ * suspended controller only has its shadow updated, which resume then
+ * programs. A zero rate leaves nothing to count SCL with and is refused.
+ * ABORT can arrive without PRE when an earlier notifier refused the
+ * change.
+ */
+static int i2c_a78_clk_notify(struct notifier_block *nb, unsigned long event,
+			      void *data)
+{
+	struct i2c_a78_dev *i2c_dev = container_of(nb, struct i2c_a78_dev, clk_nb);
+	struct clk_notifier_data *ndata = data;
+	unsigned long flags;
+	u32 prescaler, held;
+	bool changing;
+	
+	switch (event) {
+	case PRE_RATE_CHANGE:
+		if (!ndata->new_rate)
+			return notifier_from_errno(-EINVAL);
+		
+		spin_lock_irqsave(&i2c_dev->lock, flags);
+		i2c_dev->rate_changing = true;
+		i2c_dev->rate_change_start = ktime_get();
+		if (i2c_dev->stream) {
+			i2c_a78_stream_abort(i2c_dev->stream);
+			dev_dbg(i2c_dev->dev, "Stream aborted for input clock rate change\n");
+		}
+		spin_unlock_irqrestore(&i2c_dev->lock, flags);
+		
+		if (!wait_event_timeout(i2c_dev->rate_wait, !READ_ONCE(i2c_dev->xfer_busy),
+					msecs_to_jiffies(i2c_dev->timeout_ms))) {
+			dev_warn(i2c_dev->dev, "Transfer still running, refusing clock rate change\n");
+			break;
+		}
+		return NOTIFY_OK;
+	case POST_RATE_CHANGE:
+		if (i2c_a78_prescaler(i2c_dev, ndata->new_rate, &prescaler)) {
+			dev_warn(i2c_dev->dev, "Input clock stopped, keeping prescaler\n");
+			break;
+		}
+		
+		spin_lock_irqsave(&i2c_dev->lock, flags);
+		if (i2c_dev->suspended)
+			i2c_a78_set_ctx(i2c_dev, prescaler, I2C_A78_PRESCALER);
+		else
+			i2c_a78_write_ctx(i2c_dev, prescaler, I2C_A78_PRESCALER);
+		spin_unlock_irqrestore(&i2c_dev->lock, flags);
+		
+		i2c_dev->stats.clk_retunes++;
+		dev_dbg(i2c_dev->dev, "Input clock %lu -> %lu Hz, prescaler 0x%08x, bus %u Hz\n",
+			ndata->old_rate, ndata->new_rate, prescaler,
+			i2c_dev->bus_freq_actual);
+		break;
+	case ABORT_RATE_CHANGE:
+		break;
+	default:
+		return NOTIFY_DONE;
+	}
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	changing = i2c_dev->rate_changing;
+	i2c_dev->rate_changing = false;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	if (changing) {
+		wake_up(&i2c_dev->rate_wait);
+		
+		held = ktime_us_delta(ktime_get(), i2c_dev->rate_change_start);
+		i2c_dev->stats.clk_hold_us += held;
+		i2c_dev->stats.clk_hold_max_us = max(i2c_dev->stats.clk_hold_max_us, held);
+	}
+	
+	return event == PRE_RATE_CHANGE ? notifier_from_errno(-EBUSY) : NOTIFY_OK;
+}
+
 static irqreturn_t i2c_a78_isr(int irq, void *dev_id)
 {
 	struct i2c_a78_dev *i2c_dev = dev_id;
@@ -248,10 +1112,24 @@ static irqreturn_t i2c_a78_isr(int irq, void *dev_id)
 		complete(&i2c_dev->msg_complete);
 	}
 	
+	if (i2c_dev->stream && i2c_dev->state == I2C_A78_STATE_ERROR)
+		wake_up(&i2c_dev->stream->wait);
+	
 	if (int_status & (I2C_A78_INT_TX_DONE | I2C_A78_INT_RX_READY)) {
-		if (i2c_dev->state != I2C_A78_STATE_ERROR) {
+		switch (i2c_a78_seg_action(i2c_dev->state == I2C_A78_STATE_ERROR,
+					   i2c_dev->stream, i2c_dev->msg_idx,
+					   i2c_dev->batch_end)) {
+		case I2C_A78_SEG_NEXT:
+			/* Sequence the next segment of a scatter-gather batch */
+			i2c_dev->msg_idx++;
+			i2c_a78_send_address(i2c_dev, &i2c_dev->msgs[i2c_dev->msg_idx]);
+			break;
+		case I2C_A78_SEG_DONE:
 			i2c_dev->state = I2C_A78_STATE_IDLE;
-			complete(&i2c_dev->msg_complete);
+			i2c_a78_signal_event(i2c_dev, I2C_A78_EVENT_CTRL_DONE);
+			break;
+		case I2C_A78_SEG_NONE:
+			break;
 		}
 	}
 	
@@ -260,14 +1138,61 @@ static irqreturn_t i2c_a78_isr(int irq, void *dev_id)
 	return IRQ_HANDLED;
 }
 
+static void i2c_a78_debugfs_show_resume(struct seq_file *s,
+					struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	int i;
+	
+	if (!pm->keep_prepared)
+		seq_printf(s, "Runtime PM clock: unprepared on suspend\n");
+	else
+		seq_printf(s, "Runtime PM clock: gated%s, unprepared after %u ms (%u times)\n",
+			   pm->irq_safe ? " (IRQ-safe)" : "", pm->unprepare_ms,
+			   i2c_dev->stats.pm_clk_unprepares);
+	
+	if (pm->settle_us < 0)
+		seq_printf(s, "Resume settle: poll ready (%u us max, %u timeouts)\n",
+			   I2C_A78_PM_READY_TIMEOUT_US, i2c_dev->stats.pm_ready_timeouts);
+	else
+		seq_printf(s, "Resume settle: %d us fixed\n", pm->settle_us);
+	
+	seq_printf(s, "Resume latency (us, max %u):", pm->resume_max_us);
+	for (i = 0; i < I2C_A78_PM_RESUME_BUCKETS; i++) {
+		if (!pm->resume_us[i])
+			continue;
+		if (i == I2C_A78_PM_RESUME_BUCKETS - 1)
+			seq_printf(s, " >=%u: %u", 1U << (i - 1), pm->resume_us[i]);
+		else
+			seq_printf(s, " <%u: %u", 1U << i, pm->resume_us[i]);
+	}
+	seq_printf(s, "\n");
+}
+
 static int i2c_a78_debugfs_show(struct seq_file *s, void *data)
 {
 	struct i2c_a78_dev *i2c_dev = s->private;
 	
 	seq_printf(s, "I2C A78 Debug Information\n");
 	seq_printf(s, "=========================\n");
-	seq_printf(s, "Bus frequency: %u Hz\n", i2c_dev->bus_freq);
-	seq_printf(s, "DMA enabled: %s\n", i2c_dev->dma.use_dma ? "Yes" : "No");
+	seq_printf(s, "Bus frequency: %u Hz (achieved %u Hz, rise %u ns, fall %u ns, hold %u ns)\n",
+		   i2c_dev->bus_freq, i2c_dev->bus_freq_actual,
+		   i2c_dev->timings.scl_rise_ns, i2c_dev->timings.scl_fall_ns,
+		   i2c_dev->timings.sda_hold_ns);
+	seq_printf(s, "SCL periods: HIGH %u, LOW %u input clock cycles\n",
+		   (i2c_a78_read_ctx(i2c_dev, I2C_A78_PRESCALER) & I2C_A78_PRESCALER_HIGH_MASK) >>
+		   I2C_A78_PRESCALER_HIGH_SHIFT,
+		   i2c_a78_read_ctx(i2c_dev, I2C_A78_PRESCALER) & I2C_A78_PRESCALER_LOW_MASK);
+	seq_printf(s, "DMA enabled: %s\n", i2c_dev->dma.enabled ? "Yes" : "No");
+	seq_printf(s, "DMA threshold: TX %u bytes%s, RX %u bytes%s\n",
+		   i2c_dev->dma.threshold[0],
+		   i2c_dev->dma.calib_freq[0] ? " (calibrated)" : "",
+		   i2c_dev->dma.threshold[1],
+		   i2c_dev->dma.calib_freq[1] ? " (calibrated)" : "");
+	seq_printf(s, "DMA channels: %s (idle release after %u ms)\n",
+		   !i2c_dev->dma.use_dma ? "released" :
+		   i2c_dev->dma.borrower ? "borrowed per transfer" : "held",
+		   i2c_dev->dma.idle_ms);
 	seq_printf(s, "State: %d\n", i2c_dev->state);
 	seq_printf(s, "\nStatistics:\n");
 	seq_printf(s, "TX bytes: %llu\n", i2c_dev->stats.tx_bytes);
@@ -275,6 +1200,66 @@ static int i2c_a78_debugfs_show(struct seq_file *s, void *data)
 	seq_printf(s, "Timeouts: %u\n", i2c_dev->stats.timeouts);
 	seq_printf(s, "Arbitration lost: %u\n", i2c_dev->stats.arb_lost);
 	seq_printf(s, "NACKs: %u\n", i2c_dev->stats.nacks);
+	seq_printf(s, "DMA burst: TX %u/%u, RX %u/%u bytes (FIFO %u)\n",
+		   i2c_dev->dma.burst[0], i2c_dev->dma.max_burst[0],
+		   i2c_dev->dma.burst[1], i2c_dev->dma.max_burst[1],
+		   i2c_dev->dma.fifo_size);
+	seq_printf(s, "DMA acquisitions: %u (last %u us, max %u us), releases: %u\n",
+		   i2c_dev->stats.dma_acquires, i2c_dev->stats.dma_acquire_us,
+		   i2c_dev->stats.dma_acquire_max_us, i2c_dev->stats.dma_releases);
+	i2c_a78_dma_pool_show(s);
+	i2c_a78_dma_arb_show(s);
+	seq_printf(s, "DMA channel borrows: %u, waits: %u (total %llu us, max %u us), starved: %u\n",
+		   i2c_dev->stats.dma_chan_borrows, i2c_dev->stats.dma_chan_waits,
+		   i2c_dev->stats.dma_chan_wait_us, i2c_dev->stats.dma_chan_wait_max_us,
+		   i2c_dev->stats.dma_chan_starved);
+	seq_printf(s, "DMA path: %s\n", i2c_dev->dma.coherent ?
+		   "coherent, client buffers mapped in place" :
+		   "non-coherent, bounce buffer with per-chunk cache maintenance");
+	seq_printf(s, "DMA SG batches: %u, messages mapped in place: %u, bounced: %u\n",
+		   i2c_dev->stats.dma_batches, i2c_dev->stats.dma_zero_copy,
+		   i2c_dev->stats.dma_bounced);
+	seq_printf(s, "DMA messages issued ahead: %u\n",
+		   i2c_dev->stats.dma_issued_ahead);
+	seq_printf(s, "DMA descriptor cache: %llu hits, %llu misses%s\n",
+		   i2c_dev->stats.dma_desc_hits, i2c_dev->stats.dma_desc_misses,
+		   i2c_dev->dma.desc_reuse ? "" : " (reuse unsupported)");
+	seq_printf(s, "Streams: %u (%u failed or aborted)\n",
+		   i2c_dev->stats.streams, i2c_dev->stats.stream_aborts);
+	seq_printf(s, "Sessions: %u (%u transfers, %u hit the %u ms cap), total %llu us, longest %u us\n",
+		   i2c_dev->stats.sessions, i2c_dev->stats.session_xfers,
+		   i2c_dev->stats.session_expired, i2c_dev->session_max_ms,
+		   i2c_dev->stats.session_us, i2c_dev->stats.session_max_us);
+	seq_printf(s, "DMA polled completions: %u below %u us (%u slept)\n",
+		   i2c_dev->stats.dma_polled, i2c_dev->dma_poll_us,
+		   i2c_dev->stats.dma_poll_sleeps);
+	seq_printf(s, "Autosuspend delay: %u ms learned (bounds %u-%u ms, break-even %u ms)\n",
+		   i2c_dev->pm.delay_ms, i2c_dev->pm.delay_min_ms,
+		   i2c_dev->pm.delay_max_ms, i2c_dev->pm.break_even_ms);
+	seq_printf(s, "Runtime resumes: %u (%u avoided, %u added vs fixed %u ms delay)\n",
+		   i2c_dev->stats.pm_resumes, i2c_dev->stats.pm_resumes_avoided,
+		   i2c_dev->stats.pm_resumes_added, I2C_A78_PM_SUSPEND_DELAY_MS);
+	seq_printf(s, "Runtime PM references: %u held over, %u taken, %u released\n",
+		   i2c_dev->stats.pm_fast_gets, i2c_dev->stats.pm_slow_gets,
+		   i2c_dev->stats.pm_releases);
+	i2c_a78_debugfs_show_resume(s, i2c_dev);
+	if (i2c_dev->pm.qos_latency_us == PM_QOS_RESUME_LATENCY_NO_CONSTRAINT)
+		seq_printf(s, "PM QoS resume latency: none");
+	else
+		seq_printf(s, "PM QoS resume latency: %d us", i2c_dev->pm.qos_latency_us);
+	seq_printf(s, "%s, %u holds, kept awake %llu ms\n",
+		   i2c_dev->pm.qos_hold ? " (holding)" : "",
+		   i2c_dev->stats.pm_qos_holds,
+		   div_u64(i2c_a78_pm_qos_awake_us(i2c_dev), USEC_PER_MSEC));
+	seq_printf(s, "Resume hints: %u (%u hit, %u early, %u missed)\n",
+		   i2c_dev->stats.pm_hints, i2c_dev->stats.pm_hint_hits,
+		   i2c_dev->stats.pm_hint_early, i2c_dev->stats.pm_hint_misses);
+	seq_printf(s, "Input clock: %lu Hz, %u retunes, transfers held %llu us (max %u us)\n",
+		   clk_get_rate(i2c_dev->clk), i2c_dev->stats.clk_retunes,
+		   i2c_dev->stats.clk_hold_us, i2c_dev->stats.clk_hold_max_us);
+	seq_printf(s, "System sleep: %u suspends, last %u us, resume %u us (max %u us)\n",
+		   i2c_dev->stats.sys_suspends, i2c_dev->stats.sys_suspend_us,
+		   i2c_dev->stats.sys_resume_us, i2c_dev->stats.sys_resume_max_us);
 	seq_printf(s, "\nRegisters:\n");
 	seq_printf(s, "CONTROL: 0x%08x\n", i2c_a78_readl(i2c_dev, I2C_A78_CONTROL));
 	seq_printf(s, "STATUS: 0x%08x\n", i2c_a78_readl(i2c_dev, I2C_A78_STATUS));
@@ -285,6 +1270,50 @@ static int i2c_a78_debugfs_show(struct seq_file *s, void *data)
 
 DEFINE_SHOW_ATTRIBUTE(i2c_a78_debugfs);
 
+/*
+ * Writing a 7-bit target address to calibrate_read runs the PIO/DMA
+ * crossover sweep for reads against the target. calibrate_write only
+ * exists with an "arm,dma-calibration-scratch" target, and only accepts
+ * that address. dma_threshold_rx/tx show the thresholds in use and take
+ * manual overrides.
+ */
+static int i2c_a78_calibrate(struct i2c_a78_dev *i2c_dev, u64 addr, bool read)
+{
+	int ret;
+	
+	if (addr > I2C_A78_ADDRESS_7BIT_MASK)
+		return -EINVAL;
+	
+	i2c_lock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
+	ret = i2c_a78_dma_calibrate(i2c_dev, addr, read);
+	i2c_unlock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
+	
+	return ret;
+}
+
+static int i2c_a78_calibrate_read_set(void *data, u64 val)
+{
+	return i2c_a78_calibrate(data, val, true);
+}
+DEFINE_DEBUGFS_ATTRIBUTE(i2c_a78_calibrate_read_fops, NULL,
+			 i2c_a78_calibrate_read_set, "0x%02llx\n");
+
+static int i2c_a78_calibrate_write_set(void *data, u64 val)
+{
+	return i2c_a78_calibrate(data, val, false);
+}
+DEFINE_DEBUGFS_ATTRIBUTE(i2c_a78_calibrate_write_fops, NULL,
+			 i2c_a78_calibrate_write_set, "0x%02llx\n");
+
+/* Writing N to expect_xfer_us hints a transfer N microseconds from now */
+static int i2c_a78_expect_xfer_set(void *data, u64 val)
+{
+	i2c_a78_pm_hint(data, ktime_add_us(ktime_get(), val));
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(i2c_a78_expect_xfer_fops, NULL,
+			 i2c_a78_expect_xfer_set, "%llu\n");
+
 static void i2c_a78_debugfs_init(struct i2c_a78_dev *i2c_dev)
 {
 	struct dentry *root;
@@ -294,6 +1323,25 @@ static void i2c_a78_debugfs_init(struct i2c_a78_dev *i2c_dev)
 		return;
 	
 	debugfs_create_file("status", 0444, root, i2c_dev, &i2c_a78_debugfs_fops);
+	debugfs_create_u32("session_max_ms", 0644, root, &i2c_dev->session_max_ms);
+	debugfs_create_file_unsafe("expect_xfer_us", 0200, root, i2c_dev,
+				   &i2c_a78_expect_xfer_fops);
+	debugfs_create_u32("pm_delay_min_ms", 0644, root, &i2c_dev->pm.delay_min_ms);
+	debugfs_create_u32("pm_delay_max_ms", 0644, root, &i2c_dev->pm.delay_max_ms);
+	debugfs_create_u32("pm_break_even_ms", 0644, root, &i2c_dev->pm.break_even_ms);
+	
+	if (!i2c_dev->dma.enabled)
+		return;
+	
+	debugfs_create_u32("dma_threshold_tx", 0644, root, &i2c_dev->dma.threshold[0]);
+	debugfs_create_u32("dma_threshold_rx", 0644, root, &i2c_dev->dma.threshold[1]);
+	debugfs_create_u32("dma_poll_us", 0644, root, &i2c_dev->dma_poll_us);
+	debugfs_create_file_unsafe("calibrate_read", 0200, root, i2c_dev,
+				   &i2c_a78_calibrate_read_fops);
+	
+	if (i2c_dev->dma.calib_scratch >= 0)
+		debugfs_create_file_unsafe("calibrate_write", 0200, root, i2c_dev,
+					   &i2c_a78_calibrate_write_fops);
 }
 
 static int i2c_a78_probe(struct platform_device *pdev)
@@ -301,6 +1349,7 @@ static int i2c_a78_probe(struct platform_device *pdev)
 	struct device *dev = &pdev->dev;
 	struct i2c_a78_dev *i2c_dev;
 	struct resource *res;
+	u32 calib_addr;
 	int ret;
 	
 	i2c_dev = devm_kzalloc(dev, sizeof(*i2c_dev), GFP_KERNEL);
@@ -332,15 +1381,24 @@ static int i2c_a78_probe(struct platform_device *pdev)
 		return ret;
 	}
 	
+	i2c_dev->variant = of_device_get_match_data(dev);
+	if (!i2c_dev->variant)
+		i2c_dev->variant = &i2c_a78_variant_default;
+	
 	of_property_read_u32(dev->of_node, "clock-frequency", &i2c_dev->bus_freq);
 	if (!i2c_dev->bus_freq)
 		i2c_dev->bus_freq = I2C_A78_SPEED_FAST;
+	i2c_a78_init_timings(i2c_dev);
 	
 	of_property_read_u32(dev->of_node, "timeout-ms", &i2c_dev->timeout_ms);
 	if (!i2c_dev->timeout_ms)
 		i2c_dev->timeout_ms = I2C_A78_TIMEOUT_MS;
 	
+	i2c_dev->dma_poll_us = I2C_A78_DMA_POLL_US;
+	i2c_dev->session_max_ms = I2C_A78_SESSION_MAX_MS;
+	
 	spin_lock_init(&i2c_dev->lock);
+	init_waitqueue_head(&i2c_dev->rate_wait);
 	init_completion(&i2c_dev->msg_complete);
 	
 	ret = clk_prepare_enable(i2c_dev->clk);
@@ -350,13 +1408,29 @@ static int i2c_a78_probe(struct platform_device *pdev)
 	}
 	
 	ret = i2c_a78_dma_init(i2c_dev);
-	if (ret && ret != -EPROBE_DEFER) {
+	if (ret) {
 		dev_info(dev, "DMA not available, using PIO mode\n");
-		i2c_dev->dma.use_dma = false;
+		i2c_dev->dma.enabled = false;
 		ret = 0;
 	}
 	
-	i2c_a78_hw_init(i2c_dev);
+	/* Registered first so that no rate change is missed after hw_init */
+	i2c_dev->clk_nb.notifier_call = i2c_a78_clk_notify;
+	ret = clk_notifier_register(i2c_dev->clk, &i2c_dev->clk_nb);
+	if (ret) {
+		dev_warn(dev, "Failed to register clock notifier: %d\n", ret);
+		ret = 0;
+	}
+	
+	ret = i2c_a78_hw_init(i2c_dev);
+	if (ret) {
+		dev_err(dev, "No input clock rate to derive SCL from\n");
+		goto err_dma;
+	}
+	
+	ret = i2c_a78_pm_init(i2c_dev);
+	if (ret)
+		goto err_dma;
 	
 	i2c_dev->adapter.owner = THIS_MODULE;
 	i2c_dev->adapter.class = I2C_CLASS_HWMON | I2C_CLASS_SPD;
@@ -371,22 +1445,33 @@ static int i2c_a78_probe(struct platform_device *pdev)
 	ret = i2c_add_numbered_adapter(&i2c_dev->adapter);
 	if (ret) {
 		dev_err(dev, "Failed to add I2C adapter: %d\n", ret);
-		goto err_dma;
+		goto err_pm;
 	}
 	
-	ret = i2c_a78_pm_init(i2c_dev);
-	if (ret)
-		goto err_adapter;
+	/* Clients still wait for the adapter; unrelated devices need not */
+	device_enable_async_suspend(&i2c_dev->adapter.dev);
+	
+	/* The probe reference becomes the first burst reference */
+	i2c_a78_pm_put(i2c_dev);
 	
 	i2c_a78_debugfs_init(i2c_dev);
 	
-	dev_info(dev, "I2C adapter registered (bus_freq=%u Hz)\n", i2c_dev->bus_freq);
+	/* Read-only sweep against a target named by the board; failure keeps the default */
+	if (i2c_dev->dma.enabled &&
+	    !of_property_read_u32(dev->of_node, "arm,dma-calibration-address", &calib_addr))
+		i2c_a78_calibrate(i2c_dev, calib_addr, true);
+	
+	dev_info(dev, "I2C adapter registered (bus_freq=%u Hz, achieved %u Hz)\n",
+		 i2c_dev->bus_freq, i2c_dev->bus_freq_actual);
 	
 	return 0;
 	
-err_adapter:
-	i2c_del_adapter(&i2c_dev->adapter);
+err_pm:
+	i2c_a78_pm_exit(i2c_dev);
 err_dma:
+	clk_notifier_unregister(i2c_dev->clk, &i2c_dev->clk_nb);
+	if (i2c_dev->dma.enabled)
+		cancel_delayed_work_sync(&i2c_dev->dma.idle_work);
 	i2c_a78_dma_release(i2c_dev);
 	clk_disable_unprepare(i2c_dev->clk);
 	return ret;
@@ -396,8 +1481,12 @@ static int i2c_a78_remove(struct platform_device *pdev)
 {
 	struct i2c_a78_dev *i2c_dev = platform_get_drvdata(pdev);
 	
-	pm_runtime_disable(i2c_dev->dev);
+	/* No transfer can start, or resume the controller, past this point */
 	i2c_del_adapter(&i2c_dev->adapter);
+	i2c_a78_pm_exit(i2c_dev);
+	clk_notifier_unregister(i2c_dev->clk, &i2c_dev->clk_nb);
+	if (i2c_dev->dma.enabled)
+		cancel_delayed_work_sync(&i2c_dev->dma.idle_work);
 	i2c_a78_dma_release(i2c_dev);
 	clk_disable_unprepare(i2c_dev->clk);
 	
@@ -405,14 +1494,15 @@ static int i2c_a78_remove(struct platform_device *pdev)
 }
 
 static const struct of_device_id i2c_a78_dt_ids[] = {
-	{ .compatible = "arm,a78-i2c", },
+	{ .compatible = "arm,a78-i2c", .data = &i2c_a78_variant_default },
 	{ }
 };
 MODULE_DEVICE_TABLE(of, i2c_a78_dt_ids);
 
 static const struct dev_pm_ops i2c_a78_pm_ops = {
-	SET_SYSTEM_SLEEP_PM_OPS(i2c_a78_pm_suspend, i2c_a78_pm_resume)
-	SET_RUNTIME_PM_OPS(i2c_a78_pm_suspend, i2c_a78_pm_resume, NULL)
+	SET_NOIRQ_SYSTEM_SLEEP_PM_OPS(i2c_a78_pm_suspend, i2c_a78_pm_resume)
+	SET_RUNTIME_PM_OPS(i2c_a78_runtime_suspend, i2c_a78_runtime_resume, NULL)
+	.complete = i2c_a78_pm_complete,
 };
 
 static struct platform_driver i2c_a78_driver = {
@@ -1,256 +1,1966 @@
+#include <linux/bitops.h>
 #include <linux/dmaengine.h>
+#include <linux/dma-map-ops.h>
 #include <linux/dma-mapping.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/of_address.h>
 #include <linux/of_dma.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/wait.h>
 
 #include "../include/i2c-a78.h"
 
+/*
+ * Intermediate chunks of a streamed message only wake the refill loop.
+ * The last outstanding descriptor of a job records DMA_DONE instead, so
+ * the transfer thread sleeps once for both the DMA engine and the
+ * controller.
+ */
 static void i2c_a78_dma_tx_callback(void *data)
 {
 	struct i2c_a78_dev *i2c_dev = data;
 	
-	complete(&i2c_dev->dma.tx_complete);
+	if (atomic_dec_and_test(&i2c_dev->dma.pending))
+		i2c_a78_signal_event(i2c_dev, I2C_A78_EVENT_DMA_DONE);
+	else
+		complete(&i2c_dev->dma.tx_complete);
 }
 
 static void i2c_a78_dma_rx_callback(void *data)
 {
 	struct i2c_a78_dev *i2c_dev = data;
 	
-	complete(&i2c_dev->dma.rx_complete);
+	if (atomic_dec_and_test(&i2c_dev->dma.pending))
+		i2c_a78_signal_event(i2c_dev, I2C_A78_EVENT_DMA_DONE);
+	else
+		complete(&i2c_dev->dma.rx_complete);
 }
 
-static int i2c_a78_dma_config_tx(struct i2c_a78_dev *i2c_dev)
+/*
+ * The controller raises a DMA request once the TX FIFO has room for, or
+ * the RX FIFO holds, a watermark's worth of bytes. The watermark is kept
+ * equal to the channel's maxburst so every request moves a whole burst.
+ */
+static void i2c_a78_dma_set_watermark(struct i2c_a78_dev *i2c_dev, bool read,
+				      u32 burst)
+{
+	u32 thresh = i2c_a78_read_ctx(i2c_dev, I2C_A78_FIFO_THRESH);
+	
+	if (read) {
+		thresh &= ~I2C_A78_FIFO_THRESH_RX_MASK;
+		thresh |= (burst << I2C_A78_FIFO_THRESH_RX_SHIFT) &
+			  I2C_A78_FIFO_THRESH_RX_MASK;
+	} else {
+		thresh &= ~I2C_A78_FIFO_THRESH_TX_MASK;
+		thresh |= burst & I2C_A78_FIFO_THRESH_TX_MASK;
+	}
+	
+	i2c_a78_write_ctx(i2c_dev, thresh, I2C_A78_FIFO_THRESH);
+}
+
+static int i2c_a78_dma_slave_tx(struct i2c_a78_dev *i2c_dev, u32 burst)
 {
 	struct dma_slave_config tx_conf = {};
 	
 	tx_conf.direction = DMA_MEM_TO_DEV;
 	tx_conf.dst_addr = (dma_addr_t)(i2c_dev->base + I2C_A78_DATA);
 	tx_conf.dst_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE;
-	tx_conf.dst_maxburst = 1;
+	tx_conf.dst_maxburst = burst;
 	
 	return dmaengine_slave_config(i2c_dev->dma.tx_chan, &tx_conf);
 }
 
-static int i2c_a78_dma_config_rx(struct i2c_a78_dev *i2c_dev)
+static int i2c_a78_dma_config_tx(struct i2c_a78_dev *i2c_dev, u32 burst)
+{
+	int ret;
+	
+	ret = i2c_a78_dma_slave_tx(i2c_dev, burst);
+	if (ret)
+		return ret;
+	
+	i2c_dev->dma.burst[0] = burst;
+	i2c_a78_dma_set_watermark(i2c_dev, false, burst);
+	
+	return 0;
+}
+
+static int i2c_a78_dma_config_rx(struct i2c_a78_dev *i2c_dev, u32 burst)
 {
 	struct dma_slave_config rx_conf = {};
+	int ret;
 	
 	rx_conf.direction = DMA_DEV_TO_MEM;
 	rx_conf.src_addr = (dma_addr_t)(i2c_dev->base + I2C_A78_DATA);
 	rx_conf.src_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE;
-	rx_conf.src_maxburst = 1;
+	rx_conf.src_maxburst = burst;
+	
+	ret = dmaengine_slave_config(i2c_dev->dma.rx_chan, &rx_conf);
+	if (ret)
+		return ret;
+	
+	i2c_dev->dma.burst[1] = burst;
+	i2c_a78_dma_set_watermark(i2c_dev, true, burst);
 	
-	return dmaengine_slave_config(i2c_dev->dma.rx_chan, &rx_conf);
+	return 0;
 }
 
-int i2c_a78_dma_init(struct i2c_a78_dev *i2c_dev)
+static int i2c_a78_dma_set_burst(struct i2c_a78_dev *i2c_dev, bool read,
+				 u32 burst)
 {
-	struct device *dev = i2c_dev->dev;
 	int ret;
 	
-	i2c_dev->dma.tx_chan = dma_request_chan(dev, "tx");
-	if (IS_ERR(i2c_dev->dma.tx_chan)) {
-		ret = PTR_ERR(i2c_dev->dma.tx_chan);
-		if (ret != -EPROBE_DEFER)
-			dev_err(dev, "Failed to request TX DMA channel: %d\n", ret);
-		return ret;
-	}
+	if (i2c_dev->dma.burst[read] == burst)
+		return 0;
 	
-	i2c_dev->dma.rx_chan = dma_request_chan(dev, "rx");
-	if (IS_ERR(i2c_dev->dma.rx_chan)) {
-		ret = PTR_ERR(i2c_dev->dma.rx_chan);
-		if (ret != -EPROBE_DEFER)
-			dev_err(dev, "Failed to request RX DMA channel: %d\n", ret);
-		goto err_tx_chan;
-	}
+	if (read)
+		ret = i2c_a78_dma_config_rx(i2c_dev, burst);
+	else
+		ret = i2c_a78_dma_config_tx(i2c_dev, burst);
 	
-	ret = i2c_a78_dma_config_tx(i2c_dev);
-	if (ret) {
-		dev_err(dev, "Failed to configure TX DMA: %d\n", ret);
-		goto err_rx_chan;
+	if (ret)
+		dev_err(i2c_dev->dev, "Failed to set %s DMA burst to %u: %d\n",
+			read ? "RX" : "TX", burst, ret);
+	
+	return ret;
+}
+
+/*
+ * FIFO watermarks come from the variant data, optionally overridden by
+ * "arm,tx-fifo-threshold"/"arm,rx-fifo-threshold", and are rounded down
+ * to a power of two no larger than the FIFO.
+ */
+static void i2c_a78_dma_parse_fifo(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct device_node *np = i2c_dev->dev->of_node;
+	u32 tx = i2c_dev->variant->tx_burst;
+	u32 rx = i2c_dev->variant->rx_burst;
+	
+	dma->fifo_size = i2c_dev->variant->fifo_size;
+	of_property_read_u32(np, "arm,fifo-size", &dma->fifo_size);
+	of_property_read_u32(np, "arm,tx-fifo-threshold", &tx);
+	of_property_read_u32(np, "arm,rx-fifo-threshold", &rx);
+	
+	dma->max_burst[0] = rounddown_pow_of_two(clamp_t(u32, tx, 1, dma->fifo_size));
+	dma->max_burst[1] = rounddown_pow_of_two(clamp_t(u32, rx, 1, dma->fifo_size));
+}
+
+/*
+ * Descriptors for the bounce buffer only depend on direction, offset and
+ * length, so periodic transfers of the same shape can resubmit a
+ * prepared descriptor instead of building a new one. This needs the DMA
+ * engine to support descriptor reuse; otherwise every lookup misses and
+ * descriptors are prepared and freed as usual.
+ */
+static bool i2c_a78_dma_chan_reusable(struct dma_chan *chan)
+{
+	struct dma_slave_caps caps;
+	
+	if (dma_get_slave_caps(chan, &caps))
+		return false;
+	
+	return caps.descriptor_reuse;
+}
+
+static void i2c_a78_dma_flush_desc_cache(struct i2c_a78_dev *i2c_dev, bool read)
+{
+	struct i2c_a78_dma_desc *cache = i2c_dev->dma.desc_cache[read];
+	int i;
+	
+	for (i = 0; i < I2C_A78_DMA_DESC_CACHE_SIZE; i++) {
+		if (!cache[i].desc)
+			continue;
+		
+		dmaengine_desc_free(cache[i].desc);
+		cache[i].desc = NULL;
 	}
+}
+
+/*
+ * A TX tail is prepared at @burst 1 while the channel and the watermark
+ * stay at the body's burst: the request is level-triggered, so single
+ * transfers keep being issued for as long as the FIFO has room.
+ */
+static struct dma_async_tx_descriptor *
+i2c_a78_dma_get_desc(struct i2c_a78_dev *i2c_dev, bool read, size_t offset,
+		     size_t len, u32 burst, bool polled)
+{
+	const struct i2c_a78_dma_desc_key key = { offset, len, burst, polled };
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_a78_dma_desc *cache = dma->desc_cache[read];
+	struct dma_async_tx_descriptor *desc;
+	unsigned long flags = polled ? DMA_CTRL_ACK : DMA_PREP_INTERRUPT;
+	unsigned int i;
 	
-	ret = i2c_a78_dma_config_rx(i2c_dev);
-	if (ret) {
-		dev_err(dev, "Failed to configure RX DMA: %d\n", ret);
-		goto err_rx_chan;
+	if (dma->desc_reuse) {
+		for (i = 0; i < I2C_A78_DMA_DESC_CACHE_SIZE; i++) {
+			if (cache[i].desc && i2c_a78_dma_desc_match(&cache[i].key, &key)) {
+				i2c_dev->stats.dma_desc_hits++;
+				return cache[i].desc;
+			}
+		}
 	}
 	
-	i2c_dev->dma.buf_len = PAGE_SIZE;
+	i2c_dev->stats.dma_desc_misses++;
 	
-	i2c_dev->dma.tx_buf = dma_alloc_coherent(dev, i2c_dev->dma.buf_len,
-						 &i2c_dev->dma.tx_dma_buf, GFP_KERNEL);
-	if (!i2c_dev->dma.tx_buf) {
-		ret = -ENOMEM;
-		goto err_rx_chan;
+	if (read) {
+		desc = dmaengine_prep_slave_single(dma->rx_chan,
+						   dma->dma_buf + offset, len,
+						   DMA_DEV_TO_MEM, flags);
+	} else if (burst != dma->burst[0]) {
+		if (i2c_a78_dma_slave_tx(i2c_dev, burst))
+			return NULL;
+		
+		desc = dmaengine_prep_slave_single(dma->tx_chan,
+						   dma->dma_buf + offset, len,
+						   DMA_MEM_TO_DEV, flags);
+		
+		if (i2c_a78_dma_slave_tx(i2c_dev, dma->burst[0]) && desc) {
+			dmaengine_desc_free(desc);
+			return NULL;
+		}
+	} else {
+		desc = dmaengine_prep_slave_single(dma->tx_chan,
+						   dma->dma_buf + offset, len,
+						   DMA_MEM_TO_DEV, flags);
 	}
+	if (!desc)
+		return NULL;
 	
-	i2c_dev->dma.rx_buf = dma_alloc_coherent(dev, i2c_dev->dma.buf_len,
-						 &i2c_dev->dma.rx_dma_buf, GFP_KERNEL);
-	if (!i2c_dev->dma.rx_buf) {
-		ret = -ENOMEM;
-		goto err_tx_buf;
+	/* Polled descriptors are reaped through dmaengine_tx_status() */
+	if (!polled) {
+		desc->callback = read ? i2c_a78_dma_rx_callback : i2c_a78_dma_tx_callback;
+		desc->callback_param = i2c_dev;
 	}
 	
-	init_completion(&i2c_dev->dma.tx_complete);
-	init_completion(&i2c_dev->dma.rx_complete);
+	if (dma->desc_reuse && !dmaengine_desc_set_reuse(desc)) {
+		i = dma->desc_victim[read]++ % I2C_A78_DMA_DESC_CACHE_SIZE;
+		if (cache[i].desc)
+			dmaengine_desc_free(cache[i].desc);
+		
+		cache[i].desc = desc;
+		cache[i].key = key;
+	}
 	
-	i2c_dev->dma.use_dma = true;
+	return desc;
+}
+
+/*
+ * Channels and the bounce buffer are held from the first DMA-eligible
+ * transfer until the bus has been idle for dma.idle_ms across a runtime
+ * suspend, so controllers that only ever see PIO-sized messages never
+ * occupy a DMA channel.
+ */
+static void i2c_a78_dma_idle_work(struct work_struct *work)
+{
+	struct i2c_a78_dma_data *dma = container_of(to_delayed_work(work),
+						    struct i2c_a78_dma_data, idle_work);
+	struct i2c_a78_dev *i2c_dev = container_of(dma, struct i2c_a78_dev, dma);
 	
-	dev_info(dev, "DMA initialized successfully\n");
-	return 0;
+	i2c_lock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
 	
-err_tx_buf:
-	dma_free_coherent(dev, i2c_dev->dma.buf_len, i2c_dev->dma.tx_buf,
-			  i2c_dev->dma.tx_dma_buf);
-err_rx_chan:
-	dma_release_channel(i2c_dev->dma.rx_chan);
-err_tx_chan:
-	dma_release_channel(i2c_dev->dma.tx_chan);
+	if (dma->use_dma && ktime_ms_delta(ktime_get(), dma->last_use) >= dma->idle_ms) {
+		i2c_a78_dma_release(i2c_dev);
+		dev_dbg(i2c_dev->dev, "DMA channels released after %u ms idle\n",
+			dma->idle_ms);
+	}
 	
-	return ret;
+	i2c_unlock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
 }
 
-void i2c_a78_dma_release(struct i2c_a78_dev *i2c_dev)
+/**
+ * i2c_a78_dma_schedule_release - Arm the idle release of DMA resources
+ * @i2c_dev: I2C device structure
+ *
+ * Called on runtime suspend. The channels are released once dma.idle_ms
+ * has passed since the last DMA transfer, unless a new transfer uses
+ * them first.
+ */
+void i2c_a78_dma_schedule_release(struct i2c_a78_dev *i2c_dev)
 {
-	struct device *dev = i2c_dev->dev;
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	s64 idle;
 	
-	if (!i2c_dev->dma.use_dma)
+	if (!dma->use_dma)
 		return;
 	
-	if (i2c_dev->dma.tx_buf) {
-		dma_free_coherent(dev, i2c_dev->dma.buf_len, i2c_dev->dma.tx_buf,
-				  i2c_dev->dma.tx_dma_buf);
+	idle = ktime_ms_delta(ktime_get(), dma->last_use);
+	mod_delayed_work(system_wq, &dma->idle_work,
+			 msecs_to_jiffies(idle < dma->idle_ms ? dma->idle_ms - idle : 0));
+}
+
+int i2c_a78_dma_init(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct device_node *np = i2c_dev->dev->of_node;
+	u32 buf_size, scratch;
+	
+	if (!of_property_read_bool(np, "dmas"))
+		return -ENODEV;
+	
+	i2c_a78_dma_parse_fifo(i2c_dev);
+	
+	dma->idle_ms = I2C_A78_DMA_IDLE_MS;
+	of_property_read_u32(np, "arm,dma-idle-ms", &dma->idle_ms);
+	
+	buf_size = PAGE_SIZE;
+	of_property_read_u32(np, "arm,dma-buffer-size", &buf_size);
+	dma->buf_size = clamp_t(size_t, PAGE_ALIGN(buf_size), PAGE_SIZE,
+				I2C_A78_DMA_BUF_MAX);
+	
+	dma->threshold[0] = I2C_A78_DMA_THRESHOLD;
+	of_property_read_u32(np, "arm,dma-threshold", &dma->threshold[0]);
+	dma->threshold[1] = dma->threshold[0];
+	
+	/* Write calibration overwrites its target, which the board must name */
+	dma->calib_scratch = -1;
+	if (!of_property_read_u32(np, "arm,dma-calibration-scratch", &scratch) &&
+	    scratch <= I2C_A78_ADDRESS_7BIT_MASK)
+		dma->calib_scratch = scratch;
+	
+	init_completion(&dma->tx_complete);
+	init_completion(&dma->rx_complete);
+	INIT_DELAYED_WORK(&dma->idle_work, i2c_a78_dma_idle_work);
+	
+	dma->enabled = true;
+	
+	dev_info(i2c_dev->dev, "DMA available (burst TX %u RX %u, released after %u ms idle)\n",
+		 dma->max_burst[0], dma->max_burst[1], dma->idle_ms);
+	return 0;
+}
+
+/*
+ * I2C is half-duplex and messages are serialised, so a single region
+ * bounces both directions. It is cacheable and mapped once, so that the
+ * CPU copies run at cache speed and only the range of each chunk is
+ * cleaned or invalidated around the transfer. If the configured size
+ * cannot be allocated, retry with halved sizes down to one page before
+ * giving up on DMA.
+ */
+static int i2c_a78_dma_alloc_buf(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	size_t len = dma->buf_size;
+	
+	for (;;) {
+		dma->buf = kmalloc(len, GFP_KERNEL | __GFP_NOWARN);
+		if (dma->buf)
+			break;
+		
+		if (len <= PAGE_SIZE) {
+			dev_err(i2c_dev->dev, "Failed to allocate DMA bounce buffer\n");
+			return -ENOMEM;
+		}
+		
+		len = max_t(size_t, len / 2, PAGE_SIZE);
 	}
 	
-	if (i2c_dev->dma.rx_buf) {
-		dma_free_coherent(dev, i2c_dev->dma.buf_len, i2c_dev->dma.rx_buf,
-				  i2c_dev->dma.rx_dma_buf);
+	dma->dma_buf = dma_map_single(i2c_dev->dev, dma->buf, len, DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(i2c_dev->dev, dma->dma_buf)) {
+		dev_err(i2c_dev->dev, "Failed to map DMA bounce buffer\n");
+		kfree(dma->buf);
+		dma->buf = NULL;
+		return -ENOMEM;
 	}
 	
-	if (!IS_ERR_OR_NULL(i2c_dev->dma.tx_chan)) {
-		dmaengine_terminate_all(i2c_dev->dma.tx_chan);
-		dma_release_channel(i2c_dev->dma.tx_chan);
+	if (len != dma->buf_size)
+		dev_warn(i2c_dev->dev, "DMA bounce buffer reduced to %zu bytes\n", len);
+	
+	dma->buf_len = len;
+	return 0;
+}
+
+static void i2c_a78_dma_free_buf(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	
+	dma_unmap_single(i2c_dev->dev, dma->dma_buf, dma->buf_len, DMA_BIDIRECTIONAL);
+	kfree(dma->buf);
+}
+
+/*
+ * Hand a bounce buffer range to the device (@for_cpu false) or back to
+ * the CPU. Pool buffers are coherent allocations and need no maintenance;
+ * the private buffer only has the bytes of the chunk synced.
+ */
+static void i2c_a78_dma_sync(struct i2c_a78_dev *i2c_dev, size_t offset,
+			     size_t len, bool read, bool for_cpu)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	enum dma_data_direction dir = read ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	
+	if (dma->pooled)
+		return;
+	
+	if (for_cpu)
+		dma_sync_single_for_cpu(i2c_dev->dev, dma->dma_buf + offset, len, dir);
+	else
+		dma_sync_single_for_device(i2c_dev->dev, dma->dma_buf + offset, len, dir);
+}
+
+/*
+ * Optional bounce pool shared by all controller instances. Buffers are
+ * allocated for the DMA engine of the first controller to join and
+ * leased for the duration of one transfer, so coherent memory scales with
+ * the number of concurrent DMA transfers rather than with the number of
+ * controllers. Controllers behind a different DMA engine keep a private
+ * buffer.
+ */
+static unsigned int dma_pool_buffers;
+module_param(dma_pool_buffers, uint, 0444);
+MODULE_PARM_DESC(dma_pool_buffers,
+		 "Bounce buffers shared by all controllers (0 = private buffer per controller)");
+
+static bool dma_pool_block;
+module_param(dma_pool_block, bool, 0644);
+MODULE_PARM_DESC(dma_pool_block,
+		 "Wait for a free pool buffer instead of falling back to PIO");
+
+struct i2c_a78_dma_pool {
+	struct device *dev;
+	unsigned int users;
+	unsigned int count;
+	u32 busy;
+	void *buf[I2C_A78_DMA_POOL_MAX];
+	dma_addr_t dma_buf[I2C_A78_DMA_POOL_MAX];
+	
+	unsigned int peak;
+	u64 leases;
+	u32 waits;
+	u32 fallbacks;
+};
+
+static DEFINE_MUTEX(i2c_a78_pool_mutex);
+static DEFINE_SPINLOCK(i2c_a78_pool_lock);
+static DECLARE_WAIT_QUEUE_HEAD(i2c_a78_pool_wait);
+static struct i2c_a78_dma_pool i2c_a78_pool;
+
+static void i2c_a78_dma_pool_free(struct i2c_a78_dma_pool *pool)
+{
+	unsigned int i;
+	
+	for (i = 0; i < pool->count; i++)
+		dma_free_coherent(pool->dev, I2C_A78_DMA_POOL_BUF_LEN, pool->buf[i],
+				  pool->dma_buf[i]);
+	
+	pool->count = 0;
+	pool->dev = NULL;
+}
+
+/* Join the pool, creating it on first use. Returns false to use a private buffer. */
+static bool i2c_a78_dma_pool_get(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_pool *pool = &i2c_a78_pool;
+	struct device *engine = i2c_dev->dma.tx_chan->device->dev;
+	unsigned int n = min_t(unsigned int, dma_pool_buffers, I2C_A78_DMA_POOL_MAX);
+	bool joined = false;
+	
+	if (!n || engine != i2c_dev->dma.rx_chan->device->dev)
+		return false;
+	
+	mutex_lock(&i2c_a78_pool_mutex);
+	
+	if (!pool->users) {
+		pool->dev = engine;
+		
+		for (pool->count = 0; pool->count < n; pool->count++) {
+			pool->buf[pool->count] = dma_alloc_coherent(engine, I2C_A78_DMA_POOL_BUF_LEN,
+								    &pool->dma_buf[pool->count],
+								    GFP_KERNEL | __GFP_NOWARN);
+			if (!pool->buf[pool->count])
+				break;
+		}
+		
+		if (pool->count < n)
+			dev_warn(i2c_dev->dev, "DMA pool limited to %u of %u buffers\n",
+				 pool->count, n);
 	}
 	
-	if (!IS_ERR_OR_NULL(i2c_dev->dma.rx_chan)) {
-		dmaengine_terminate_all(i2c_dev->dma.rx_chan);
-		dma_release_channel(i2c_dev->dma.rx_chan);
+	if (pool->count && pool->dev == engine) {
+		pool->users++;
+		joined = true;
+	} else if (!pool->users) {
+		i2c_a78_dma_pool_free(pool);
 	}
 	
-	i2c_dev->dma.use_dma = false;
+	mutex_unlock(&i2c_a78_pool_mutex);
+	
+	return joined;
 }
 
-static int i2c_a78_dma_submit_tx(struct i2c_a78_dev *i2c_dev, const u8 *buf, size_t len)
+static void i2c_a78_dma_pool_put(void)
 {
-	struct dma_async_tx_descriptor *tx_desc;
-	dma_cookie_t cookie;
+	mutex_lock(&i2c_a78_pool_mutex);
 	
-	if (len > i2c_dev->dma.buf_len) {
-		dev_err(i2c_dev->dev, "TX buffer too large: %zu > %zu\n",
-			len, i2c_dev->dma.buf_len);
-		return -EINVAL;
-	}
+	if (!--i2c_a78_pool.users)
+		i2c_a78_dma_pool_free(&i2c_a78_pool);
 	
-	memcpy(i2c_dev->dma.tx_buf, buf, len);
+	mutex_unlock(&i2c_a78_pool_mutex);
+}
+
+static int i2c_a78_dma_pool_take(void)
+{
+	struct i2c_a78_dma_pool *pool = &i2c_a78_pool;
+	unsigned long flags;
+	int idx;
 	
-	reinit_completion(&i2c_dev->dma.tx_complete);
+	spin_lock_irqsave(&i2c_a78_pool_lock, flags);
 	
-	tx_desc = dmaengine_prep_slave_single(i2c_dev->dma.tx_chan,
-					      i2c_dev->dma.tx_dma_buf, len,
-					      DMA_MEM_TO_DEV, DMA_PREP_INTERRUPT);
-	if (!tx_desc) {
-		dev_err(i2c_dev->dev, "Failed to prepare TX DMA descriptor\n");
-		return -ENOMEM;
+	idx = i2c_a78_dma_pool_pick(pool->busy, pool->count);
+	if (idx >= 0) {
+		pool->busy |= BIT(idx);
+		pool->leases++;
+		pool->peak = max_t(unsigned int, pool->peak, hweight32(pool->busy));
 	}
 	
-	tx_desc->callback = i2c_a78_dma_tx_callback;
-	tx_desc->callback_param = i2c_dev;
+	spin_unlock_irqrestore(&i2c_a78_pool_lock, flags);
 	
-	cookie = dmaengine_submit(tx_desc);
-	if (dma_submit_error(cookie)) {
-		dev_err(i2c_dev->dev, "Failed to submit TX DMA\n");
-		return -EIO;
+	return idx;
+}
+
+/*
+ * DMA channel arbitration across controller instances. A controller that
+ * obtains its own "tx"/"rx" pair lends it to the other instances between
+ * its own transfers; one whose request failed, typically because the
+ * engine has run out of channels, borrows a pair for each DMA transfer
+ * instead of staying in PIO mode. A pair is reconfigured for the DATA
+ * register and FIFO watermarks of the controller using it whenever it was
+ * last configured by another one.
+ */
+struct i2c_a78_dma_chan_pair {
+	struct dma_chan *tx_chan;
+	struct dma_chan *rx_chan;
+	struct i2c_a78_dev *owner;
+	struct i2c_a78_dev *config;
+};
+
+struct i2c_a78_dma_arb {
+	struct i2c_a78_dma_chan_pair pairs[I2C_A78_DMA_ARB_MAX];
+	u32 present;
+	u32 busy;
+	u64 leases;
+	u64 borrows;
+};
+
+static DEFINE_SPINLOCK(i2c_a78_arb_lock);
+static DECLARE_WAIT_QUEUE_HEAD(i2c_a78_arb_wait);
+static struct i2c_a78_dma_arb i2c_a78_arb;
+
+/* Offer the controller's own channels. Returns the pair index, or -1 to keep them private. */
+static int i2c_a78_dma_arb_add(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_arb *arb = &i2c_a78_arb;
+	unsigned long flags;
+	int idx = -1;
+	
+	spin_lock_irqsave(&i2c_a78_arb_lock, flags);
+	
+	if (arb->present != GENMASK(I2C_A78_DMA_ARB_MAX - 1, 0)) {
+		idx = ffz(arb->present);
+		arb->pairs[idx].tx_chan = i2c_dev->dma.tx_chan;
+		arb->pairs[idx].rx_chan = i2c_dev->dma.rx_chan;
+		arb->pairs[idx].owner = i2c_dev;
+		arb->pairs[idx].config = i2c_dev;
+		arb->present |= BIT(idx);
 	}
 	
-	dma_async_issue_pending(i2c_dev->dma.tx_chan);
+	spin_unlock_irqrestore(&i2c_a78_arb_lock, flags);
 	
-	return 0;
+	return idx;
 }
 
-static int i2c_a78_dma_submit_rx(struct i2c_a78_dev *i2c_dev, size_t len)
+static bool i2c_a78_dma_arb_withdraw(struct i2c_a78_dev *i2c_dev, int idx)
 {
-	struct dma_async_tx_descriptor *rx_desc;
-	dma_cookie_t cookie;
+	struct i2c_a78_dma_arb *arb = &i2c_a78_arb;
+	unsigned long flags;
+	bool idle;
 	
-	if (len > i2c_dev->dma.buf_len) {
-		dev_err(i2c_dev->dev, "RX buffer too large: %zu > %zu\n",
-			len, i2c_dev->dma.buf_len);
-		return -EINVAL;
+	spin_lock_irqsave(&i2c_a78_arb_lock, flags);
+	
+	idle = !(arb->busy & BIT(idx));
+	if (idle) {
+		i2c_dev->dma.tx_chan = arb->pairs[idx].tx_chan;
+		i2c_dev->dma.rx_chan = arb->pairs[idx].rx_chan;
+		memset(&arb->pairs[idx], 0, sizeof(arb->pairs[idx]));
+		arb->present &= ~BIT(idx);
 	}
 	
-	reinit_completion(&i2c_dev->dma.rx_complete);
+	spin_unlock_irqrestore(&i2c_a78_arb_lock, flags);
 	
-	rx_desc = dmaengine_prep_slave_single(i2c_dev->dma.rx_chan,
-					      i2c_dev->dma.rx_dma_buf, len,
-					      DMA_DEV_TO_MEM, DMA_PREP_INTERRUPT);
-	if (!rx_desc) {
-		dev_err(i2c_dev->dev, "Failed to prepare RX DMA descriptor\n");
-		return -ENOMEM;
-	}
+	return idle;
+}
+
+/*
+ * Take the controller's own channels back out of arbitration before they
+ * are released, waiting for a borrower to finish its transfer first.
+ */
+static void i2c_a78_dma_arb_remove(struct i2c_a78_dev *i2c_dev)
+{
+	int idx = i2c_dev->dma.arb_idx;
 	
-	rx_desc->callback = i2c_a78_dma_rx_callback;
-	rx_desc->callback_param = i2c_dev;
+	if (idx < 0)
+		return;
 	
-	cookie = dmaengine_submit(rx_desc);
-	if (dma_submit_error(cookie)) {
-		dev_err(i2c_dev->dev, "Failed to submit RX DMA\n");
-		return -EIO;
+	wait_event(i2c_a78_arb_wait, i2c_a78_dma_arb_withdraw(i2c_dev, idx));
+	i2c_dev->dma.arb_idx = -1;
+}
+
+/* Prefer the controller's own pair, then any other idle one */
+static int i2c_a78_dma_arb_take(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_arb *arb = &i2c_a78_arb;
+	int own = i2c_dev->dma.arb_idx;
+	unsigned long flags;
+	u32 idle;
+	int idx = -1;
+	
+	spin_lock_irqsave(&i2c_a78_arb_lock, flags);
+	
+	idle = arb->present & ~arb->busy;
+	idx = i2c_a78_dma_arb_pick(idle, own);
+	if (idx >= 0) {
+		arb->busy |= BIT(idx);
+		arb->leases++;
+		if (idx != own)
+			arb->borrows++;
 	}
 	
-	dma_async_issue_pending(i2c_dev->dma.rx_chan);
+	spin_unlock_irqrestore(&i2c_a78_arb_lock, flags);
 	
-	return 0;
+	return idx;
 }
 
-int i2c_a78_dma_xfer(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
+static void i2c_a78_dma_arb_put(int idx)
 {
-	unsigned long timeout;
-	int ret;
+	unsigned long flags;
 	
-	if (!i2c_dev->dma.use_dma || msg->len < I2C_A78_DMA_THRESHOLD)
-		return -EINVAL;
+	spin_lock_irqsave(&i2c_a78_arb_lock, flags);
+	i2c_a78_arb.busy &= ~BIT(idx);
+	spin_unlock_irqrestore(&i2c_a78_arb_lock, flags);
 	
-	if (msg->flags & I2C_M_RD) {
-		ret = i2c_a78_dma_submit_rx(i2c_dev, msg->len);
-		if (ret)
-			return ret;
+	wake_up(&i2c_a78_arb_wait);
+}
+
+/*
+ * Lease a channel pair for one transfer, waiting up to the transfer
+ * timeout while every pair is in use. Controllers whose channels could
+ * not be entered into arbitration keep using them directly.
+ */
+static int i2c_a78_dma_chan_lease(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_a78_dma_chan_pair *pair;
+	ktime_t start;
+	u32 waited;
+	int idx, ret;
+	
+	if (dma->arb_idx < 0 && !dma->borrower)
+		return 0;
+	
+	idx = i2c_a78_dma_arb_take(i2c_dev);
+	if (idx < 0 && i2c_a78_arb.present) {
+		start = ktime_get();
+		wait_event_timeout(i2c_a78_arb_wait,
+				   (idx = i2c_a78_dma_arb_take(i2c_dev)) >= 0,
+				   msecs_to_jiffies(i2c_dev->timeout_ms));
 		
-		timeout = wait_for_completion_timeout(&i2c_dev->dma.rx_complete,
-						      msecs_to_jiffies(i2c_dev->timeout_ms));
-		if (!timeout) {
-			dev_err(i2c_dev->dev, "RX DMA timeout\n");
-			dmaengine_terminate_all(i2c_dev->dma.rx_chan);
-			return -ETIMEDOUT;
-		}
+		waited = ktime_us_delta(ktime_get(), start);
+		i2c_dev->stats.dma_chan_waits++;
+		i2c_dev->stats.dma_chan_wait_us += waited;
+		i2c_dev->stats.dma_chan_wait_max_us = max(i2c_dev->stats.dma_chan_wait_max_us,
+							  waited);
+	}
+	
+	if (idx < 0) {
+		i2c_dev->stats.dma_chan_starved++;
+		return -EBUSY;
+	}
+	
+	pair = &i2c_a78_arb.pairs[idx];
+	if (pair->tx_chan != dma->tx_chan || pair->config != i2c_dev) {
+		/* Cached descriptors belong to another pair or configuration */
+		i2c_a78_dma_flush_desc_cache(i2c_dev, false);
+		i2c_a78_dma_flush_desc_cache(i2c_dev, true);
 		
-		memcpy(msg->buf, i2c_dev->dma.rx_buf, msg->len);
-		i2c_dev->stats.rx_bytes += msg->len;
-	} else {
-		ret = i2c_a78_dma_submit_tx(i2c_dev, msg->buf, msg->len);
-		if (ret)
-			return ret;
+		dma->tx_chan = pair->tx_chan;
+		dma->rx_chan = pair->rx_chan;
 		
-		timeout = wait_for_completion_timeout(&i2c_dev->dma.tx_complete,
-						      msecs_to_jiffies(i2c_dev->timeout_ms));
-		if (!timeout) {
-			dev_err(i2c_dev->dev, "TX DMA timeout\n");
-			dmaengine_terminate_all(i2c_dev->dma.tx_chan);
-			return -ETIMEDOUT;
+		ret = i2c_a78_dma_config_tx(i2c_dev, dma->max_burst[0]);
+		if (!ret)
+			ret = i2c_a78_dma_config_rx(i2c_dev, dma->max_burst[1]);
+		if (ret) {
+			dev_err(i2c_dev->dev, "Failed to configure shared DMA channels: %d\n", ret);
+			pair->config = NULL;
+			i2c_a78_dma_arb_put(idx);
+			return ret;
 		}
 		
-		i2c_dev->stats.tx_bytes += msg->len;
+		pair->config = i2c_dev;
+		dma->desc_reuse = i2c_a78_dma_chan_reusable(dma->tx_chan) &&
+				  i2c_a78_dma_chan_reusable(dma->rx_chan);
+	}
+	
+	if (pair->owner != i2c_dev)
+		i2c_dev->stats.dma_chan_borrows++;
+	
+	dma->arb_lease = idx;
+	return 0;
+}
+
+static void i2c_a78_dma_chan_return(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	int idx = dma->arb_lease;
+	
+	if (idx < 0)
+		return;
+	
+	/* The owner may release a borrowed pair as soon as it is returned */
+	if (i2c_a78_arb.pairs[idx].owner != i2c_dev) {
+		i2c_a78_dma_flush_desc_cache(i2c_dev, false);
+		i2c_a78_dma_flush_desc_cache(i2c_dev, true);
+		dma->tx_chan = NULL;
+		dma->rx_chan = NULL;
+	}
+	
+	dma->arb_lease = -1;
+	i2c_a78_dma_arb_put(idx);
+}
+
+void i2c_a78_dma_arb_show(struct seq_file *s)
+{
+	struct i2c_a78_dma_arb *arb = &i2c_a78_arb;
+	
+	if (!arb->present)
+		return;
+	
+	seq_printf(s, "DMA channel pairs: %u/%u in use, %llu leases, %llu borrowed\n",
+		   hweight32(arb->busy), hweight32(arb->present), arb->leases,
+		   arb->borrows);
+}
+
+/**
+ * i2c_a78_dma_lease - Obtain DMA channels and a bounce buffer for a transfer
+ * @i2c_dev: I2C device structure
+ *
+ * Takes a channel pair from arbitration, then a bounce buffer. Controllers
+ * with a private buffer always get one. Pool users take a free pool
+ * buffer, waiting up to the transfer timeout for one if dma_pool_block is
+ * set.
+ *
+ * Returns: 0 on success, -EBUSY if the transfer has to fall back to PIO
+ */
+int i2c_a78_dma_lease(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	unsigned long flags;
+	int idx, ret;
+	
+	ret = i2c_a78_dma_chan_lease(i2c_dev);
+	if (ret)
+		return ret;
+	
+	if (!dma->pooled)
+		return 0;
+	
+	idx = i2c_a78_dma_pool_take();
+	if (idx < 0 && dma_pool_block) {
+		spin_lock_irqsave(&i2c_a78_pool_lock, flags);
+		i2c_a78_pool.waits++;
+		spin_unlock_irqrestore(&i2c_a78_pool_lock, flags);
+		
+		wait_event_timeout(i2c_a78_pool_wait,
+				   (idx = i2c_a78_dma_pool_take()) >= 0,
+				   msecs_to_jiffies(i2c_dev->timeout_ms));
+	}
+	
+	if (idx < 0) {
+		spin_lock_irqsave(&i2c_a78_pool_lock, flags);
+		i2c_a78_pool.fallbacks++;
+		spin_unlock_irqrestore(&i2c_a78_pool_lock, flags);
+		
+		i2c_a78_dma_chan_return(i2c_dev);
+		return -EBUSY;
+	}
+	
+	/* Cached descriptors point into the previously leased buffer */
+	if (i2c_a78_pool.dma_buf[idx] != dma->dma_buf) {
+		i2c_a78_dma_flush_desc_cache(i2c_dev, false);
+		i2c_a78_dma_flush_desc_cache(i2c_dev, true);
 	}
 	
+	dma->pool_idx = idx;
+	dma->buf = i2c_a78_pool.buf[idx];
+	dma->dma_buf = i2c_a78_pool.dma_buf[idx];
+	
 	return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * i2c_a78_dma_return - Give the leased channels and bounce buffer back
+ * @i2c_dev: I2C device structure
+ */
+void i2c_a78_dma_return(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	unsigned long flags;
+	
+	i2c_a78_dma_chan_return(i2c_dev);
+	
+	if (!dma->pooled || dma->pool_idx < 0)
+		return;
+	
+	spin_lock_irqsave(&i2c_a78_pool_lock, flags);
+	i2c_a78_pool.busy &= ~BIT(dma->pool_idx);
+	spin_unlock_irqrestore(&i2c_a78_pool_lock, flags);
+	
+	dma->pool_idx = -1;
+	dma->buf = NULL;
+	
+	wake_up(&i2c_a78_pool_wait);
+}
+
+void i2c_a78_dma_pool_show(struct seq_file *s)
+{
+	struct i2c_a78_dma_pool *pool = &i2c_a78_pool;
+	
+	if (!pool->count)
+		return;
+	
+	seq_printf(s, "DMA pool: %u/%u buffers in use (peak %u), %llu leases, %u waits, %u PIO fallbacks\n",
+		   hweight32(pool->busy), pool->count, pool->peak, pool->leases,
+		   pool->waits, pool->fallbacks);
+}
+
+static int i2c_a78_dma_request_chans(struct i2c_a78_dev *i2c_dev)
+{
+	struct device *dev = i2c_dev->dev;
+	int ret;
+	
+	i2c_dev->dma.tx_chan = dma_request_chan(dev, "tx");
+	if (IS_ERR(i2c_dev->dma.tx_chan)) {
+		ret = PTR_ERR(i2c_dev->dma.tx_chan);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Failed to request TX DMA channel: %d\n", ret);
+		i2c_dev->dma.tx_chan = NULL;
+		return ret;
+	}
+	
+	i2c_dev->dma.rx_chan = dma_request_chan(dev, "rx");
+	if (IS_ERR(i2c_dev->dma.rx_chan)) {
+		ret = PTR_ERR(i2c_dev->dma.rx_chan);
+		if (ret != -EPROBE_DEFER)
+			dev_err(dev, "Failed to request RX DMA channel: %d\n", ret);
+		goto err_tx_chan;
+	}
+	
+	ret = i2c_a78_dma_config_tx(i2c_dev, i2c_dev->dma.max_burst[0]);
+	if (ret) {
+		dev_err(dev, "Failed to configure TX DMA: %d\n", ret);
+		goto err_rx_chan;
+	}
+	
+	ret = i2c_a78_dma_config_rx(i2c_dev, i2c_dev->dma.max_burst[1]);
+	if (ret) {
+		dev_err(dev, "Failed to configure RX DMA: %d\n", ret);
+		goto err_rx_chan;
+	}
+	
+	return 0;
+	
+err_rx_chan:
+	dma_release_channel(i2c_dev->dma.rx_chan);
+err_tx_chan:
+	dma_release_channel(i2c_dev->dma.tx_chan);
+	
+	i2c_dev->dma.tx_chan = NULL;
+	i2c_dev->dma.rx_chan = NULL;
+	return ret;
+}
+
+/*
+ * The controller only raises DMA requests while it holds channels to
+ * serve them. A suspended controller picks the change up from the
+ * context on resume.
+ */
+static void i2c_a78_dma_enable_requests(struct i2c_a78_dev *i2c_dev, bool enable)
+{
+	u32 mask = I2C_A78_CONTROL_DMA_TX_EN | I2C_A78_CONTROL_DMA_RX_EN;
+	unsigned long flags;
+	u32 control;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	
+	control = i2c_a78_read_ctx(i2c_dev, I2C_A78_CONTROL);
+	control = enable ? control | mask : control & ~mask;
+	
+	if (i2c_dev->suspended)
+		i2c_a78_set_ctx(i2c_dev, control, I2C_A78_CONTROL);
+	else
+		i2c_a78_write_ctx(i2c_dev, control, I2C_A78_CONTROL);
+	
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+}
+
+/**
+ * i2c_a78_dma_acquire - Request DMA channels and the bounce buffer
+ * @i2c_dev: I2C device structure
+ *
+ * Called from the transfer path on the first DMA-eligible message after
+ * probe or after an idle release. Channels that are obtained are entered
+ * into arbitration; if none can be obtained the controller borrows other
+ * controllers' channels per transfer. The time taken is recorded in the
+ * statistics.
+ *
+ * Returns: 0 on success, negative error code otherwise
+ */
+int i2c_a78_dma_acquire(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct device *dev = i2c_dev->dev;
+	ktime_t start = ktime_get();
+	u32 latency;
+	int ret;
+	
+	ret = i2c_a78_dma_request_chans(i2c_dev);
+	if (ret == -EPROBE_DEFER)
+		return ret;
+	
+	dma->arb_idx = -1;
+	dma->arb_lease = -1;
+	dma->borrower = ret != 0;
+	if (dma->borrower)
+		dev_info(dev, "No dedicated DMA channels (%d), borrowing from other controllers\n",
+			 ret);
+	
+	/*
+	 * Coherency belongs to the DMA engine, not to this node. A coherent
+	 * engine maps client buffers and needs no bounce buffer. Borrowers
+	 * cannot tell which engine they will run on and keep a private one.
+	 */
+	dma->coherent = !dma->borrower &&
+			dev_is_dma_coherent(dma->tx_chan->device->dev) &&
+			dev_is_dma_coherent(dma->rx_chan->device->dev);
+	dma->pool_idx = -1;
+	dma->pooled = false;
+	if (dma->coherent) {
+		dma->buf_len = 0;
+	} else if (!dma->borrower && i2c_a78_dma_pool_get(i2c_dev)) {
+		dma->pooled = true;
+		dma->buf_len = I2C_A78_DMA_POOL_BUF_LEN;
+	} else {
+		ret = i2c_a78_dma_alloc_buf(i2c_dev);
+		if (ret)
+			goto err_chans;
+	}
+	
+	if (!dma->borrower) {
+		dma->desc_reuse = i2c_a78_dma_chan_reusable(dma->tx_chan) &&
+				  i2c_a78_dma_chan_reusable(dma->rx_chan);
+		dma->arb_idx = i2c_a78_dma_arb_add(i2c_dev);
+	}
+	
+	dma->use_dma = true;
+	i2c_a78_dma_enable_requests(i2c_dev, true);
+	
+	latency = ktime_us_delta(ktime_get(), start);
+	i2c_dev->stats.dma_acquires++;
+	i2c_dev->stats.dma_acquire_us = latency;
+	i2c_dev->stats.dma_acquire_max_us = max(i2c_dev->stats.dma_acquire_max_us, latency);
+	
+	dev_dbg(dev, "DMA channels acquired in %u us (%s, descriptor reuse %s)\n",
+		latency, dma->coherent ? "zero-copy" : "bounce buffered",
+		dma->desc_reuse ? "enabled" : "unsupported");
+	return 0;
+	
+err_chans:
+	if (!dma->borrower) {
+		dma_release_channel(dma->rx_chan);
+		dma_release_channel(dma->tx_chan);
+		dma->tx_chan = NULL;
+		dma->rx_chan = NULL;
+	}
+	
+	return ret;
+}
+
+void i2c_a78_dma_release(struct i2c_a78_dev *i2c_dev)
+{
+	if (!i2c_dev->dma.use_dma)
+		return;
+	
+	i2c_a78_dma_enable_requests(i2c_dev, false);
+	
+	if (i2c_dev->dma.pooled) {
+		i2c_a78_dma_pool_put();
+		i2c_dev->dma.pooled = false;
+	} else if (i2c_dev->dma.buf) {
+		i2c_a78_dma_free_buf(i2c_dev);
+	}
+	
+	i2c_a78_dma_flush_desc_cache(i2c_dev, false);
+	i2c_a78_dma_flush_desc_cache(i2c_dev, true);
+	
+	i2c_a78_dma_arb_remove(i2c_dev);
+	
+	if (i2c_dev->dma.borrower) {
+		i2c_dev->dma.tx_chan = NULL;
+		i2c_dev->dma.rx_chan = NULL;
+		i2c_dev->dma.borrower = false;
+	}
+	
+	if (!IS_ERR_OR_NULL(i2c_dev->dma.tx_chan)) {
+		dmaengine_terminate_all(i2c_dev->dma.tx_chan);
+		dma_release_channel(i2c_dev->dma.tx_chan);
+	}
+	
+	if (!IS_ERR_OR_NULL(i2c_dev->dma.rx_chan)) {
+		dmaengine_terminate_all(i2c_dev->dma.rx_chan);
+		dma_release_channel(i2c_dev->dma.rx_chan);
+	}
+	
+	i2c_dev->dma.tx_chan = NULL;
+	i2c_dev->dma.rx_chan = NULL;
+	i2c_dev->dma.buf = NULL;
+	i2c_dev->dma.dma_buf = 0;
+	i2c_dev->dma.burst[0] = 0;
+	i2c_dev->dma.burst[1] = 0;
+	i2c_dev->dma.use_dma = false;
+	i2c_dev->stats.dma_releases++;
+}
+
+static int i2c_a78_dma_submit_tx(struct i2c_a78_dev *i2c_dev, size_t offset,
+				 const u8 *buf, size_t len, u32 burst)
+{
+	struct dma_async_tx_descriptor *tx_desc;
+	dma_cookie_t cookie;
+	
+	if (offset + len > i2c_dev->dma.buf_len) {
+		dev_err(i2c_dev->dev, "TX chunk out of range: %zu+%zu > %zu\n",
+			offset, len, i2c_dev->dma.buf_len);
+		return -EINVAL;
+	}
+	
+	memcpy(i2c_dev->dma.buf + offset, buf, len);
+	i2c_a78_dma_sync(i2c_dev, offset, len, false, false);
+	
+	tx_desc = i2c_a78_dma_get_desc(i2c_dev, false, offset, len, burst,
+				       i2c_dev->dma.active->polled);
+	if (!tx_desc) {
+		dev_err(i2c_dev->dev, "Failed to prepare TX DMA descriptor\n");
+		return -ENOMEM;
+	}
+	
+	cookie = dmaengine_submit(tx_desc);
+	if (dma_submit_error(cookie)) {
+		dev_err(i2c_dev->dev, "Failed to submit TX DMA\n");
+		return -EIO;
+	}
+	i2c_dev->dma.active->cookie = cookie;
+	
+	dma_async_issue_pending(i2c_dev->dma.tx_chan);
+	
+	return 0;
+}
+
+static int i2c_a78_dma_submit_rx(struct i2c_a78_dev *i2c_dev, size_t offset,
+				 size_t len)
+{
+	struct dma_async_tx_descriptor *rx_desc;
+	dma_cookie_t cookie;
+	
+	if (offset + len > i2c_dev->dma.buf_len) {
+		dev_err(i2c_dev->dev, "RX chunk out of range: %zu+%zu > %zu\n",
+			offset, len, i2c_dev->dma.buf_len);
+		return -EINVAL;
+	}
+	
+	i2c_a78_dma_sync(i2c_dev, offset, len, true, false);
+	
+	rx_desc = i2c_a78_dma_get_desc(i2c_dev, true, offset, len,
+				       i2c_dev->dma.burst[1],
+				       i2c_dev->dma.active->polled);
+	if (!rx_desc) {
+		dev_err(i2c_dev->dev, "Failed to prepare RX DMA descriptor\n");
+		return -ENOMEM;
+	}
+	
+	cookie = dmaengine_submit(rx_desc);
+	if (dma_submit_error(cookie)) {
+		dev_err(i2c_dev->dev, "Failed to submit RX DMA\n");
+		return -EIO;
+	}
+	i2c_dev->dma.active->cookie = cookie;
+	
+	dma_async_issue_pending(i2c_dev->dma.rx_chan);
+	
+	return 0;
+}
+
+static int i2c_a78_dma_wait_chunk(struct i2c_a78_dev *i2c_dev,
+				  struct completion *done)
+{
+	unsigned long timeout;
+	
+	timeout = wait_for_completion_timeout(done,
+					      msecs_to_jiffies(i2c_dev->timeout_ms));
+	
+	return timeout ? 0 : -ETIMEDOUT;
+}
+
+/*
+ * Messages that do not fit in the bounce buffer are streamed through it
+ * in two half-buffer slots: one slot is refilled by the CPU while the
+ * DMA engine is still draining the other, so the controller sees a
+ * continuous byte stream and the transaction keeps a single address
+ * phase.
+ */
+static size_t i2c_a78_dma_job_offset(struct i2c_a78_dma_job *job, size_t pos)
+{
+	return i2c_a78_dma_slot_offset(job->base, job->chunk, pos);
+}
+
+/* Retire completed chunks up to @upto, copying RX data out of its slot */
+static void i2c_a78_dma_retire(struct i2c_a78_dev *i2c_dev,
+			       struct i2c_a78_dma_job *job, size_t upto)
+{
+	struct i2c_msg *msg = job->msgs;
+	size_t offset, len;
+	
+	while (job->done < upto) {
+		len = min_t(size_t, upto - job->done, job->chunk);
+		offset = i2c_a78_dma_job_offset(job, job->done);
+		
+		if (job->read) {
+			i2c_a78_dma_sync(i2c_dev, offset, len, true, true);
+			memcpy(msg->buf + job->done, i2c_dev->dma.buf + offset, len);
+		}
+		
+		job->done += len;
+	}
+}
+
+/*
+ * The tail of an RX job is short of a whole burst, so it never raises a
+ * DMA request and stays in the FIFO until the message is complete.
+ */
+static void i2c_a78_dma_read_tail(struct i2c_a78_dev *i2c_dev, u8 *buf,
+				  size_t len)
+{
+	while (len--)
+		*buf++ = i2c_a78_readl(i2c_dev, I2C_A78_DATA) & 0xFF;
+}
+
+/*
+ * Jobs live in a two-entry ring: the transfer thread starts jobs at
+ * @head and finishes them at @tail. A second job only exists while the
+ * first is on the bus, when it has been prepared in the other half of
+ * the bounce buffer by i2c_a78_dma_prepare_next().
+ */
+static struct i2c_a78_dma_job *i2c_a78_dma_new_job(struct i2c_a78_dma_data *dma,
+						   struct i2c_msg *msgs, int num)
+{
+	struct i2c_a78_dma_job *job = &dma->jobs[dma->head];
+	
+	job->msgs = msgs;
+	job->num = num;
+	job->read = msgs[0].flags & I2C_M_RD;
+	job->sg = false;
+	job->base = 0;
+	job->chunk = 0;
+	job->tail = 0;
+	job->done = 0;
+	job->ok = false;
+	job->polled = false;
+	
+	return job;
+}
+
+static void i2c_a78_dma_advance(unsigned int *idx)
+{
+	*idx = (*idx + 1) % I2C_A78_DMA_SLOTS;
+}
+
+/*
+ * Start a bounce-buffer DMA transfer for @msg. Chunks are queued until
+ * the last one has been submitted; completion of the final chunk is left
+ * to the caller's wait on msg_complete, followed by i2c_a78_dma_finish().
+ * The body of the message is moved at the largest burst that fits it; a
+ * TX tail follows as a descriptor of its own, an RX tail is read out of
+ * the FIFO by i2c_a78_dma_finish(). A @polled transfer must fit the
+ * buffer in one chunk; its descriptors raise no interrupt and are reaped
+ * with i2c_a78_dma_polled_done().
+ */
+int i2c_a78_dma_xfer(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg,
+		     bool polled)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_a78_dma_job *job;
+	struct completion *chunk_done;
+	size_t queued = 0, body, end, len;
+	u32 burst;
+	int ret;
+	
+	if (!dma->xfer_dma || !dma->buf || !i2c_a78_dma_wanted(i2c_dev, msg))
+		return -EINVAL;
+	if (polled && msg->len > dma->buf_len)
+		return -EINVAL;
+	
+	job = i2c_a78_dma_new_job(dma, msg, 1);
+	job->chunk = i2c_a78_dma_chunk_len(dma->buf_len, msg->len);
+	job->polled = polled;
+	
+	burst = i2c_a78_dma_body_burst(dma->max_burst[job->read], msg->len);
+	job->tail = i2c_a78_dma_tail(burst, msg->len);
+	body = msg->len - job->tail;
+	end = job->read ? body : msg->len;
+	
+	ret = i2c_a78_dma_set_burst(i2c_dev, job->read, burst);
+	if (ret)
+		return ret;
+	chunk_done = job->read ? &dma->rx_complete : &dma->tx_complete;
+	
+	dma->active = job;
+	atomic_set(&dma->pending, DIV_ROUND_UP(body, job->chunk) + (end > body));
+	reinit_completion(chunk_done);
+	
+	while (queued < end) {
+		if (queued - job->done >= I2C_A78_DMA_SLOTS * job->chunk) {
+			ret = i2c_a78_dma_wait_chunk(i2c_dev, chunk_done);
+			if (ret) {
+				dev_err(i2c_dev->dev, "%s DMA timeout at offset %zu\n",
+					job->read ? "RX" : "TX", job->done);
+				goto err_terminate;
+			}
+			
+			i2c_a78_dma_retire(i2c_dev, job, job->done + job->chunk);
+		}
+		
+		if (queued < body) {
+			len = min_t(size_t, body - queued, job->chunk);
+		} else {
+			len = job->tail;
+			burst = 1;
+		}
+		
+		if (job->read)
+			ret = i2c_a78_dma_submit_rx(i2c_dev,
+						    i2c_a78_dma_job_offset(job, queued), len);
+		else
+			ret = i2c_a78_dma_submit_tx(i2c_dev,
+						    i2c_a78_dma_job_offset(job, queued),
+						    msg->buf + queued, len, burst);
+		if (ret)
+			goto err_terminate;
+		
+		queued += len;
+	}
+	
+	i2c_a78_dma_advance(&dma->head);
+	return 0;
+	
+err_terminate:
+	dmaengine_terminate_all(job->read ? dma->rx_chan : dma->tx_chan);
+	i2c_a78_dma_flush_desc_cache(i2c_dev, job->read);
+	return ret;
+}
+
+/**
+ * i2c_a78_dma_prepare_next - Stage the next message while the current one runs
+ * @i2c_dev: I2C device structure
+ * @msg: Message that follows the one currently on the bus
+ *
+ * When both the in-flight job and @msg fit in half of the bounce buffer,
+ * copies @msg's TX data into the idle half so that the completion path
+ * only has to submit a descriptor and program the address phase. Does
+ * nothing when the message cannot be pipelined.
+ */
+void i2c_a78_dma_prepare_next(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	size_t half = dma->buf_len / I2C_A78_DMA_SLOTS;
+	struct i2c_a78_dma_job *cur = dma->active;
+	bool read = msg->flags & I2C_M_RD;
+	struct i2c_a78_dma_job *job;
+	unsigned long flags;
+	size_t tail;
+	u32 burst;
+	
+	if (!cur || cur->sg || !i2c_a78_dma_wanted(i2c_dev, msg) ||
+	    !i2c_a78_dma_can_stage(half, cur->chunk, msg->len))
+		return;
+	
+	/* An RX tail must leave the FIFO before the next message's bytes */
+	if (cur->read && cur->tail)
+		return;
+	
+	/*
+	 * The channel cannot be reconfigured from the completion path, nor
+	 * a TX tail be given its own descriptor there.
+	 */
+	burst = i2c_a78_dma_body_burst(dma->max_burst[read], msg->len);
+	tail = i2c_a78_dma_tail(burst, msg->len);
+	if (burst != dma->burst[read] || (!read && tail))
+		return;
+	
+	job = i2c_a78_dma_new_job(dma, msg, 1);
+	job->base = i2c_a78_dma_stage_base(half, cur->base);
+	job->chunk = msg->len;
+	job->tail = tail;
+	
+	if (!job->read)
+		memcpy(dma->buf + job->base, msg->buf, msg->len);
+	i2c_a78_dma_sync(i2c_dev, job->base, msg->len, job->read, false);
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	dma->next = job;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+}
+
+/*
+ * The TX tail of a scatter-gather job is mapped straight from the client
+ * buffer and moved by a burst-1 descriptor of its own, queued behind the
+ * body on the same channel. No bounce buffer is needed, so this also
+ * works on coherent systems that have none.
+ */
+static int i2c_a78_dma_sg_tail(struct i2c_a78_dev *i2c_dev,
+			       struct i2c_a78_dma_job *job, u8 *buf)
+{
+	unsigned long flags = job->polled ? DMA_CTRL_ACK : DMA_PREP_INTERRUPT;
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct device *map_dev = dma->tx_chan->device->dev;
+	struct dma_async_tx_descriptor *desc = NULL;
+	dma_cookie_t cookie;
+	
+	dma->sg_tail = dma_map_single(map_dev, buf, job->tail, DMA_TO_DEVICE);
+	if (dma_mapping_error(map_dev, dma->sg_tail)) {
+		dev_err(i2c_dev->dev, "Failed to map %zu-byte DMA tail\n", job->tail);
+		return -ENOMEM;
+	}
+	
+	if (!i2c_a78_dma_slave_tx(i2c_dev, 1)) {
+		desc = dmaengine_prep_slave_single(dma->tx_chan, dma->sg_tail,
+						   job->tail, DMA_MEM_TO_DEV, flags);
+		if (i2c_a78_dma_slave_tx(i2c_dev, dma->burst[0]) && desc) {
+			dmaengine_desc_free(desc);
+			desc = NULL;
+		}
+	}
+	if (!desc) {
+		dev_err(i2c_dev->dev, "Failed to prepare TX tail DMA descriptor\n");
+		goto err_unmap;
+	}
+	
+	if (!job->polled) {
+		desc->callback = i2c_a78_dma_tx_callback;
+		desc->callback_param = i2c_dev;
+	}
+	
+	cookie = dmaengine_submit(desc);
+	if (dma_submit_error(cookie)) {
+		dev_err(i2c_dev->dev, "Failed to submit TX tail DMA\n");
+		goto err_unmap;
+	}
+	job->cookie = cookie;
+	
+	dma_async_issue_pending(dma->tx_chan);
+	
+	return 0;
+	
+err_unmap:
+	dma_unmap_single(map_dev, dma->sg_tail, job->tail, DMA_TO_DEVICE);
+	return -ENOMEM;
+}
+
+/**
+ * i2c_a78_dma_issue_next - Submit the job staged by i2c_a78_dma_prepare_next()
+ * @i2c_dev: I2C device structure
+ *
+ * Called from the completion path of the previous job with i2c_dev->lock
+ * held, so the DMA engine is restarted without waiting for the transfer
+ * thread to be scheduled.
+ *
+ * Returns: 0 on success, negative error code if the job must be started
+ * by the transfer thread instead
+ */
+int i2c_a78_dma_issue_next(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_a78_dma_job *job = dma->next;
+	struct dma_async_tx_descriptor *desc;
+	struct dma_chan *chan;
+	
+	dma->next = NULL;
+	if (!job)
+		return -EINVAL;
+	
+	chan = job->read ? dma->rx_chan : dma->tx_chan;
+	
+	desc = i2c_a78_dma_get_desc(i2c_dev, job->read, job->base,
+				    job->chunk - job->tail, dma->burst[job->read],
+				    false);
+	if (!desc)
+		return -ENOMEM;
+	
+	if (dma_submit_error(dmaengine_submit(desc)))
+		return -EIO;
+	
+	dma->active = job;
+	atomic_set(&dma->pending, 1);
+	dma_async_issue_pending(chan);
+	
+	i2c_a78_dma_advance(&dma->head);
+	i2c_dev->stats.dma_issued_ahead++;
+	
+	return 0;
+}
+
+/*
+ * Start a run of same-direction messages as one scatter-gather job. The
+ * client buffers are mapped directly (bounced by the I2C core only when
+ * not DMA-safe); the ISR programs the address phase of each following
+ * segment, while the DMA engine is flow-controlled by the FIFO requests.
+ * Only the last segment may end in a partial burst: a TX tail is sent
+ * by i2c_a78_dma_sg_tail(), an RX tail is read out of the FIFO by
+ * i2c_a78_dma_finish(). A @polled job is a single message whose
+ * descriptors raise no interrupt, reaped with i2c_a78_dma_polled_done().
+ */
+int i2c_a78_dma_xfer_sg(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msgs, int num,
+			bool polled)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	bool read = msgs[0].flags & I2C_M_RD;
+	struct dma_chan *chan = read ? dma->rx_chan : dma->tx_chan;
+	enum dma_data_direction map_dir = read ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	struct device *map_dev = chan->device->dev;
+	struct dma_async_tx_descriptor *desc;
+	struct i2c_msg *last = &msgs[num - 1];
+	struct i2c_a78_dma_job *job;
+	dma_cookie_t cookie;
+	size_t tail;
+	u32 burst;
+	int i, nents, ret;
+	
+	if (!dma->xfer_dma || num < 1 || num > I2C_A78_DMA_MAX_SEGS ||
+	    (polled && num > 1))
+		return -EINVAL;
+	
+	burst = i2c_a78_dma_body_burst(dma->max_burst[read], last->len);
+	tail = i2c_a78_dma_tail(burst, last->len);
+	
+	ret = i2c_a78_dma_set_burst(i2c_dev, read, burst);
+	if (ret)
+		return ret;
+	
+	sg_init_table(dma->sgl, num);
+	
+	for (i = 0; i < num; i++) {
+		dma->sg_bufs[i] = i2c_get_dma_safe_msg_buf(&msgs[i], 1);
+		if (!dma->sg_bufs[i]) {
+			ret = -ENOMEM;
+			goto err_put;
+		}
+		
+		sg_set_buf(&dma->sgl[i], dma->sg_bufs[i],
+			   msgs[i].len - (i == num - 1 ? tail : 0));
+	}
+	
+	nents = dma_map_sg(map_dev, dma->sgl, num, map_dir);
+	if (!nents) {
+		dev_err(i2c_dev->dev, "Failed to map %d DMA segments\n", num);
+		ret = -ENOMEM;
+		goto err_put;
+	}
+	
+	desc = dmaengine_prep_slave_sg(chan, dma->sgl, nents,
+				       read ? DMA_DEV_TO_MEM : DMA_MEM_TO_DEV,
+				       polled ? DMA_CTRL_ACK : DMA_PREP_INTERRUPT);
+	if (!desc) {
+		dev_err(i2c_dev->dev, "Failed to prepare SG DMA descriptor\n");
+		ret = -ENOMEM;
+		goto err_unmap;
+	}
+	
+	if (!polled) {
+		desc->callback = read ? i2c_a78_dma_rx_callback : i2c_a78_dma_tx_callback;
+		desc->callback_param = i2c_dev;
+	}
+	
+	job = i2c_a78_dma_new_job(dma, msgs, num);
+	job->sg = true;
+	job->tail = tail;
+	job->polled = polled;
+	
+	dma->active = job;
+	atomic_set(&dma->pending, tail && !read ? 2 : 1);
+	
+	cookie = dmaengine_submit(desc);
+	if (dma_submit_error(cookie)) {
+		dev_err(i2c_dev->dev, "Failed to submit SG DMA\n");
+		ret = -EIO;
+		goto err_unmap;
+	}
+	job->cookie = cookie;
+	
+	if (tail && !read) {
+		ret = i2c_a78_dma_sg_tail(i2c_dev, job,
+					  dma->sg_bufs[num - 1] + last->len - tail);
+		if (ret) {
+			dmaengine_terminate_all(chan);
+			goto err_unmap;
+		}
+	} else {
+		dma_async_issue_pending(chan);
+	}
+	
+	i2c_a78_dma_advance(&dma->head);
+	return 0;
+	
+err_unmap:
+	dma_unmap_sg(map_dev, dma->sgl, num, map_dir);
+err_put:
+	while (i-- > 0)
+		i2c_put_dma_safe_msg_buf(dma->sg_bufs[i], &msgs[i], false);
+	
+	return ret;
+}
+
+/**
+ * i2c_a78_dma_polled_done - Check whether a polled DMA job has completed
+ * @i2c_dev: I2C device structure
+ *
+ * Queries the engine for the status of the active job's descriptor
+ * instead of waiting for its completion callback.
+ *
+ * Returns: true once the DMA engine reports the transfer complete
+ */
+bool i2c_a78_dma_polled_done(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_a78_dma_job *job = dma->active;
+	
+	return dmaengine_tx_status(job->read ? dma->rx_chan : dma->tx_chan,
+				   job->cookie, NULL) == DMA_COMPLETE;
+}
+
+/**
+ * i2c_a78_dma_finish - Complete the oldest outstanding DMA job
+ * @i2c_dev: I2C device structure
+ * @ret: Result of the wait on msg_complete
+ *
+ * Called once after the transfer thread has been woken. Tears the DMA
+ * state down on error, otherwise copies out remaining RX chunks or unmaps
+ * the scatter-gather list and accounts the transferred bytes. A job that
+ * was staged but not issued in time is dropped and will be started by the
+ * transfer thread as usual.
+ *
+ * Returns: 0 on success, negative error code otherwise
+ */
+int i2c_a78_dma_finish(struct i2c_a78_dev *i2c_dev, int ret)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_a78_dma_job *job = &dma->jobs[dma->tail];
+	bool read = job->read;
+	struct dma_chan *chan = read ? dma->rx_chan : dma->tx_chan;
+	unsigned long flags;
+	size_t total = 0;
+	int i;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	dma->next = NULL;
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	/* Woken by a controller error before the DMA engine was done */
+	if (!ret && !job->ok)
+		ret = -EIO;
+	
+	if (ret) {
+		/* A job issued ahead may be running on either channel */
+		dmaengine_terminate_all(dma->tx_chan);
+		dmaengine_terminate_all(dma->rx_chan);
+		i2c_a78_dma_flush_desc_cache(i2c_dev, false);
+		i2c_a78_dma_flush_desc_cache(i2c_dev, true);
+	}
+	
+	if (job->sg) {
+		dma_unmap_sg(chan->device->dev, dma->sgl, job->num,
+			     read ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+		if (!read && job->tail)
+			dma_unmap_single(chan->device->dev, dma->sg_tail, job->tail,
+					 DMA_TO_DEVICE);
+		
+		if (!ret && read && job->tail) {
+			i = job->num - 1;
+			i2c_a78_dma_read_tail(i2c_dev, dma->sg_bufs[i] + job->msgs[i].len -
+					      job->tail, job->tail);
+		}
+		
+		for (i = 0; i < job->num; i++) {
+			total += job->msgs[i].len;
+			
+			/* The I2C core bounces buffers that are not DMA-safe */
+			if (!ret && dma->sg_bufs[i] == job->msgs[i].buf)
+				i2c_dev->stats.dma_zero_copy++;
+			else if (!ret)
+				i2c_dev->stats.dma_bounced++;
+			
+			i2c_put_dma_safe_msg_buf(dma->sg_bufs[i], &job->msgs[i], !ret);
+		}
+		
+		if (!ret && job->num > 1)
+			i2c_dev->stats.dma_batches++;
+	} else {
+		total = job->msgs->len;
+		
+		if (!ret && read) {
+			i2c_a78_dma_retire(i2c_dev, job, total - job->tail);
+			i2c_a78_dma_read_tail(i2c_dev, job->msgs->buf + total - job->tail,
+					      job->tail);
+		} else if (!ret) {
+			i2c_a78_dma_retire(i2c_dev, job, total);
+		}
+	}
+	
+	if (ret) {
+		dma->head = 0;
+		dma->tail = 0;
+		dma->active = NULL;
+		dma->issued_ahead = false;
+		return ret;
+	}
+	
+	i2c_a78_dma_advance(&dma->tail);
+	
+	if (read)
+		i2c_dev->stats.rx_bytes += total;
+	else
+		i2c_dev->stats.tx_bytes += total;
+	
+	return 0;
+}
+
+/*
+ * PIO/DMA crossover calibration. The best of a few runs is timed in each
+ * mode for every length, walking down from the longest; the threshold is
+ * the shortest length from which DMA is never slower than PIO.
+ */
+static const u16 i2c_a78_calib_lens[] = { 8, 16, 24, 32, 48, 64, 96, 128, 192, 256 };
+
+#define I2C_A78_CALIB_RUNS	4
+
+static s64 i2c_a78_dma_time_xfer(struct i2c_a78_dev *i2c_dev,
+				 struct i2c_msg *msg, u32 threshold)
+{
+	bool read = msg->flags & I2C_M_RD;
+	s64 best = S64_MAX;
+	ktime_t start;
+	int i, ret;
+	
+	i2c_dev->dma.threshold[read] = threshold;
+	
+	for (i = 0; i < I2C_A78_CALIB_RUNS; i++) {
+		start = ktime_get();
+		ret = __i2c_transfer(&i2c_dev->adapter, msg, 1);
+		if (ret != 1)
+			return ret < 0 ? ret : -EIO;
+		
+		best = min_t(s64, best, ktime_to_ns(ktime_sub(ktime_get(), start)));
+	}
+	
+	return best;
+}
+
+/**
+ * i2c_a78_dma_calibrate - Measure the PIO/DMA crossover for one direction
+ * @i2c_dev: I2C device structure
+ * @addr: 7-bit address of a target that tolerates the sweep
+ * @read: Calibrate reads if true, writes otherwise
+ *
+ * Times PIO and DMA transfers of increasing length at the current bus
+ * speed and sets the threshold for @read accordingly. A write sweep sends
+ * zero bytes to @addr, which must be the scratch target named by
+ * "arm,dma-calibration-scratch". Must be called with the adapter locked.
+ *
+ * Returns: 0 on success, -EPERM for a write sweep to any other target,
+ * negative error code otherwise; the previous threshold is kept on failure
+ */
+int i2c_a78_dma_calibrate(struct i2c_a78_dev *i2c_dev, u16 addr, bool read)
+{
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct i2c_msg msg = { .addr = addr, .flags = read ? I2C_M_RD : 0 };
+	s64 pio[ARRAY_SIZE(i2c_a78_calib_lens)], dma_ns[ARRAY_SIZE(i2c_a78_calib_lens)];
+	u32 old = dma->threshold[read];
+	u32 found;
+	int i, ret = 0;
+	
+	if (!dma->enabled)
+		return -ENODEV;
+	if (!read && addr != dma->calib_scratch)
+		return -EPERM;
+	
+	msg.buf = kzalloc(i2c_a78_calib_lens[ARRAY_SIZE(i2c_a78_calib_lens) - 1],
+			  GFP_KERNEL);
+	if (!msg.buf)
+		return -ENOMEM;
+	
+	for (i = ARRAY_SIZE(i2c_a78_calib_lens) - 1; i >= 0; i--) {
+		msg.len = i2c_a78_calib_lens[i];
+		
+		pio[i] = i2c_a78_dma_time_xfer(i2c_dev, &msg, I2C_A78_DMA_THRESHOLD_OFF);
+		if (pio[i] < 0) {
+			ret = pio[i];
+			break;
+		}
+		
+		dma_ns[i] = i2c_a78_dma_time_xfer(i2c_dev, &msg, msg.len);
+		if (dma_ns[i] < 0) {
+			ret = dma_ns[i];
+			break;
+		}
+		
+		dev_dbg(i2c_dev->dev, "%s %u bytes: PIO %lld ns, DMA %lld ns\n",
+			read ? "RX" : "TX", msg.len, pio[i], dma_ns[i]);
+		
+		/* Shorter lengths cannot lower the threshold any more */
+		if (dma_ns[i] > pio[i])
+			break;
+	}
+	
+	kfree(msg.buf);
+	
+	if (ret) {
+		dma->threshold[read] = old;
+		dev_err(i2c_dev->dev, "%s DMA threshold calibration failed: %d\n",
+			read ? "RX" : "TX", ret);
+		return ret;
+	}
+	
+	/* The sweep measured lengths from i up */
+	if (i < 0)
+		i = 0;
+	found = i2c_a78_dma_crossover(i2c_a78_calib_lens + i, pio + i, dma_ns + i,
+				      ARRAY_SIZE(i2c_a78_calib_lens) - i);
+	dma->threshold[read] = found;
+	dma->calib_freq[read] = i2c_dev->bus_freq;
+	
+	dev_info(i2c_dev->dev, "%s DMA threshold calibrated to %u bytes at %u Hz\n",
+		 read ? "RX" : "TX", found, i2c_dev->bus_freq);
+	return 0;
+}
+
+/*
+ * Streaming writes keep one address phase open while client buffers are
+ * queued to the TX channel back to back. Segment lengths are not known
+ * when the stream starts, so the FIFO requests single bytes; the bus,
+ * not the DMA engine, is the bottleneck either way.
+ */
+int i2c_a78_dma_stream_start(struct i2c_a78_stream *stream)
+{
+	struct i2c_a78_dev *i2c_dev = stream->i2c_dev;
+	int ret;
+	
+	if (!i2c_dev->dma.use_dma) {
+		ret = i2c_a78_dma_acquire(i2c_dev);
+		if (ret)
+			return ret;
+	}
+	
+	ret = i2c_a78_dma_lease(i2c_dev);
+	if (ret)
+		return ret;
+	
+	ret = i2c_a78_dma_set_burst(i2c_dev, false, 1);
+	if (ret) {
+		i2c_a78_dma_return(i2c_dev);
+		return ret;
+	}
+	
+	init_waitqueue_head(&stream->wait);
+	atomic_set(&stream->completed, 0);
+	
+	return 0;
+}
+
+static void i2c_a78_dma_stream_callback(void *param)
+{
+	struct i2c_a78_stream *stream = param;
+	
+	atomic_inc(&stream->completed);
+	wake_up(&stream->wait);
+}
+
+static bool i2c_a78_dma_stream_ready(struct i2c_a78_stream *stream)
+{
+	return atomic_read(&stream->completed) != stream->tail ||
+	       READ_ONCE(stream->aborted) ||
+	       READ_ONCE(stream->i2c_dev->state) == I2C_A78_STATE_ERROR;
+}
+
+/* Wait for the oldest queued segment and unmap it */
+static int i2c_a78_dma_stream_retire(struct i2c_a78_stream *stream)
+{
+	struct i2c_a78_dev *i2c_dev = stream->i2c_dev;
+	struct i2c_a78_stream_seg *seg = &stream->segs[stream->tail % I2C_A78_STREAM_DEPTH];
+	unsigned long timeout;
+	
+	timeout = msecs_to_jiffies(i2c_a78_stream_seg_ms(i2c_dev->timeout_ms, seg->len,
+							 i2c_dev->bus_freq));
+	
+	if (!wait_event_timeout(stream->wait, i2c_a78_dma_stream_ready(stream), timeout)) {
+		dev_err(i2c_dev->dev, "Stream segment %u timeout\n", stream->tail);
+		i2c_dev->stats.timeouts++;
+		return -ETIMEDOUT;
+	}
+	
+	if (READ_ONCE(stream->aborted))
+		return -ECANCELED;
+	
+	if (READ_ONCE(i2c_dev->state) == I2C_A78_STATE_ERROR)
+		return -EIO;
+	
+	dma_unmap_single(i2c_dev->dma.tx_chan->device->dev, seg->addr, seg->len,
+			 DMA_TO_DEVICE);
+	i2c_dev->stats.tx_bytes += seg->len;
+	stream->tail++;
+	
+	return 0;
+}
+
+/**
+ * i2c_a78_stream_write - Queue a buffer on an open stream
+ * @stream: Stream returned by i2c_a78_stream_open()
+ * @buf: DMA-safe data to send
+ * @len: Number of bytes, not limited to the u16 of struct i2c_msg
+ *
+ * Blocks while I2C_A78_STREAM_DEPTH segments are already queued, until
+ * the oldest has gone out. @buf belongs to the stream until that many
+ * further writes have returned, or until i2c_a78_stream_flush() or
+ * i2c_a78_stream_close() returns.
+ *
+ * Returns: 0 on success, -ECANCELED after an abort, -EIO on a bus error,
+ * other negative error codes on DMA failures
+ */
+int i2c_a78_stream_write(struct i2c_a78_stream *stream, const void *buf,
+			 size_t len)
+{
+	struct i2c_a78_dev *i2c_dev = stream->i2c_dev;
+	struct i2c_a78_dma_data *dma = &i2c_dev->dma;
+	struct device *map_dev = dma->tx_chan->device->dev;
+	struct dma_async_tx_descriptor *desc;
+	struct i2c_a78_stream_seg *seg;
+	int ret;
+	
+	if (READ_ONCE(stream->aborted))
+		return -ECANCELED;
+	
+	if (READ_ONCE(i2c_dev->state) == I2C_A78_STATE_ERROR)
+		return -EIO;
+	
+	if (!len)
+		return 0;
+	
+	if (i2c_a78_stream_full(stream->head, stream->tail)) {
+		ret = i2c_a78_dma_stream_retire(stream);
+		if (ret)
+			return ret;
+	}
+	
+	seg = &stream->segs[stream->head % I2C_A78_STREAM_DEPTH];
+	seg->addr = dma_map_single(map_dev, (void *)buf, len, DMA_TO_DEVICE);
+	if (dma_mapping_error(map_dev, seg->addr))
+		return -ENOMEM;
+	seg->len = len;
+	
+	desc = dmaengine_prep_slave_single(dma->tx_chan, seg->addr, len,
+					   DMA_MEM_TO_DEV, DMA_PREP_INTERRUPT);
+	if (!desc) {
+		dev_err(i2c_dev->dev, "Failed to prepare stream DMA descriptor\n");
+		ret = -ENOMEM;
+		goto err_unmap;
+	}
+	
+	desc->callback = i2c_a78_dma_stream_callback;
+	desc->callback_param = stream;
+	
+	if (dma_submit_error(dmaengine_submit(desc))) {
+		dev_err(i2c_dev->dev, "Failed to submit stream DMA\n");
+		ret = -EIO;
+		goto err_unmap;
+	}
+	
+	stream->head++;
+	dma_async_issue_pending(dma->tx_chan);
+	
+	return 0;
+	
+err_unmap:
+	dma_unmap_single(map_dev, seg->addr, len, DMA_TO_DEVICE);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_stream_write);
+
+/**
+ * i2c_a78_stream_flush - Wait until every queued segment has gone out
+ * @stream: Stream returned by i2c_a78_stream_open()
+ *
+ * The transaction stays open; all buffers passed to
+ * i2c_a78_stream_write() so far may be reused afterwards.
+ *
+ * Returns: 0 on success, negative error code as for i2c_a78_stream_write()
+ */
+int i2c_a78_stream_flush(struct i2c_a78_stream *stream)
+{
+	int ret = 0;
+	
+	while (!ret && stream->tail != stream->head)
+		ret = i2c_a78_dma_stream_retire(stream);
+	
+	return ret;
+}
+EXPORT_SYMBOL_GPL(i2c_a78_stream_flush);
+
+/**
+ * i2c_a78_stream_abort - Cancel an open stream
+ * @stream: Stream returned by i2c_a78_stream_open()
+ *
+ * May be called from any context, including while another thread is
+ * blocked in i2c_a78_stream_write(). Queued segments are dropped and
+ * further writes fail with -ECANCELED; the owner still has to call
+ * i2c_a78_stream_close() to end the transaction.
+ */
+void i2c_a78_stream_abort(struct i2c_a78_stream *stream)
+{
+	WRITE_ONCE(stream->aborted, true);
+	dmaengine_terminate_async(stream->i2c_dev->dma.tx_chan);
+	wake_up(&stream->wait);
+}
+EXPORT_SYMBOL_GPL(i2c_a78_stream_abort);
+
+/*
+ * Drain the stream for i2c_a78_stream_close(). On failure the channel is
+ * stopped and the remaining segments are unmapped without being sent.
+ */
+int i2c_a78_dma_stream_stop(struct i2c_a78_stream *stream)
+{
+	struct i2c_a78_dev *i2c_dev = stream->i2c_dev;
+	struct dma_chan *chan = i2c_dev->dma.tx_chan;
+	struct i2c_a78_stream_seg *seg;
+	int ret;
+	
+	ret = i2c_a78_stream_flush(stream);
+	if (!ret)
+		return 0;
+	
+	dmaengine_terminate_sync(chan);
+	i2c_a78_dma_flush_desc_cache(i2c_dev, false);
+	
+	while (stream->tail != stream->head) {
+		seg = &stream->segs[stream->tail++ % I2C_A78_STREAM_DEPTH];
+		dma_unmap_single(chan->device->dev, seg->addr, seg->len, DMA_TO_DEVICE);
+	}
+	
+	return ret;
+}
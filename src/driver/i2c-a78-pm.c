@@ -1,33 +1,269 @@
+#include <linux/bitops.h>
 #include <linux/pm_runtime.h>
 #include <linux/clk.h>
 #include <linux/delay.h>
+#include <linux/iopoll.h>
+#include <linux/of.h>
 
 #include "../include/i2c-a78.h"
 
-static void i2c_a78_save_context(struct i2c_a78_dev *i2c_dev)
+/*
+ * The register context lives in i2c_dev->ctx and is updated on every
+ * write, so suspend has nothing to save. On resume only registers that
+ * differ from their reset value are rewritten, CONTROL last so that the
+ * controller is enabled with its timing already in place. FIFOs and
+ * interrupt status come out of reset empty.
+ */
+static void i2c_a78_restore_context(struct i2c_a78_dev *i2c_dev)
 {
-	i2c_dev->saved_control = i2c_a78_readl(i2c_dev, I2C_A78_CONTROL);
-	i2c_dev->saved_prescaler = i2c_a78_readl(i2c_dev, I2C_A78_PRESCALER);
+	unsigned long dirty = i2c_a78_ctx_restore_mask(&i2c_dev->ctx);
+	unsigned int idx;
+	
+	for_each_set_bit(idx, &dirty, I2C_A78_CTX_NREGS)
+		i2c_a78_writel(i2c_dev, i2c_dev->ctx.regs[idx], idx * 4);
 	
-	dev_dbg(i2c_dev->dev, "Context saved: control=0x%08x, prescaler=0x%08x\n",
-		i2c_dev->saved_control, i2c_dev->saved_prescaler);
+	if (i2c_dev->ctx.dirty & BIT(I2C_A78_CONTROL / 4))
+		i2c_a78_writel(i2c_dev, i2c_a78_read_ctx(i2c_dev, I2C_A78_CONTROL),
+			       I2C_A78_CONTROL);
+	
+	dev_dbg(i2c_dev->dev, "Context restored: %u registers (dirty 0x%03x)\n",
+		hweight32(i2c_dev->ctx.dirty), i2c_dev->ctx.dirty);
 }
 
-static void i2c_a78_restore_context(struct i2c_a78_dev *i2c_dev)
+/*
+ * The register interface reads as zero until the controller's clock
+ * domain is running and out of reset. STATUS then shows at least its
+ * reset value, RX FIFO empty, which is polled for unless the variant or
+ * the device tree gives a fixed settle time. A controller that does not
+ * come up is restored anyway, and its first transfer times out.
+ */
+static void i2c_a78_wait_ready(struct i2c_a78_dev *i2c_dev)
+{
+	int settle_us = i2c_dev->pm.settle_us;
+	u32 status;
+	
+	if (settle_us >= 0) {
+		if (settle_us)
+			udelay(settle_us);
+		return;
+	}
+	
+	if (readl_relaxed_poll_timeout_atomic(i2c_dev->base + I2C_A78_STATUS, status,
+					      i2c_a78_status_ready(status), 0,
+					      I2C_A78_PM_READY_TIMEOUT_US)) {
+		i2c_dev->stats.pm_ready_timeouts++;
+		dev_warn_ratelimited(i2c_dev->dev, "Not ready %u us after clock enable\n",
+				     I2C_A78_PM_READY_TIMEOUT_US);
+	}
+}
+
+/*
+ * The PM core only honours a resume latency constraint of 0 by itself. A
+ * constraint tighter than the worst resume seen so far, or than the
+ * datasheet figure before the first one, holds a runtime PM reference so
+ * the controller stays up for as long as the constraint does. Only the
+ * usage count is touched here, so that this also works from an IRQ-safe
+ * resume callback. Returns true if the hold changed, for the caller to
+ * request the resume or suspend that calls for.
+ */
+static bool i2c_a78_pm_qos_update(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	unsigned long flags;
+	bool hold;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	
+	hold = i2c_a78_pm_qos_hold(pm->qos_latency_us, pm->resume_max_us);
+	if (hold == pm->qos_hold) {
+		spin_unlock_irqrestore(&i2c_dev->lock, flags);
+		return false;
+	}
+	
+	pm->qos_hold = hold;
+	if (hold) {
+		pm->qos_since = ktime_get();
+		pm_runtime_get_noresume(i2c_dev->dev);
+		i2c_dev->stats.pm_qos_holds++;
+	} else {
+		pm->qos_awake_us += ktime_us_delta(ktime_get(), pm->qos_since);
+		pm_runtime_mark_last_busy(i2c_dev->dev);
+		pm_runtime_put_noidle(i2c_dev->dev);
+	}
+	
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	return true;
+}
+
+static int i2c_a78_pm_qos_notify(struct notifier_block *nb, unsigned long value,
+				 void *data)
+{
+	struct i2c_a78_pm_data *pm = container_of(nb, struct i2c_a78_pm_data, qos_nb);
+	struct i2c_a78_dev *i2c_dev = container_of(pm, struct i2c_a78_dev, pm);
+	
+	WRITE_ONCE(pm->qos_latency_us, (s32)value);
+	if (!i2c_a78_pm_qos_update(i2c_dev))
+		return NOTIFY_OK;
+	
+	if (pm->qos_hold)
+		pm_request_resume(i2c_dev->dev);
+	else
+		pm_request_autosuspend(i2c_dev->dev);
+	
+	return NOTIFY_OK;
+}
+
+/**
+ * i2c_a78_pm_qos_awake_us - Time the controller was kept resumed by PM QoS
+ * @i2c_dev: I2C device structure
+ *
+ * Returns: total length of all QoS holds, the current one included
+ */
+u64 i2c_a78_pm_qos_awake_us(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	unsigned long flags;
+	u64 awake_us;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	awake_us = pm->qos_awake_us;
+	if (pm->qos_hold)
+		awake_us += ktime_us_delta(ktime_get(), pm->qos_since);
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	return awake_us;
+}
+
+/*
+ * With arm,keep-clock-prepared, runtime PM only gates the clock. Prepare
+ * may sleep on PLL or regulator work and stays out of the resume path. The
+ * clock is unprepared on system suspend, and after unprepare_ms of runtime
+ * suspend unless that is 0. In the latter case nothing on the runtime path
+ * can sleep and the callbacks are IRQ-safe.
+ */
+static int i2c_a78_clk_prepare(struct i2c_a78_dev *i2c_dev)
 {
-	i2c_a78_writel(i2c_dev, i2c_dev->saved_prescaler, I2C_A78_PRESCALER);
-	i2c_a78_writel(i2c_dev, i2c_dev->saved_control, I2C_A78_CONTROL);
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	int ret = 0;
 	
-	i2c_a78_writel(i2c_dev, I2C_A78_CONTROL_FIFO_TX_CLR | I2C_A78_CONTROL_FIFO_RX_CLR,
-		       I2C_A78_CONTROL);
+	mutex_lock(&pm->clk_lock);
+	if (!pm->clk_prepared) {
+		ret = clk_prepare(i2c_dev->clk);
+		pm->clk_prepared = !ret;
+	}
+	mutex_unlock(&pm->clk_lock);
 	
-	i2c_a78_writel(i2c_dev, 0xFF, I2C_A78_INTERRUPT);
+	return ret;
+}
+
+static void i2c_a78_clk_unprepare(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
 	
-	dev_dbg(i2c_dev->dev, "Context restored: control=0x%08x, prescaler=0x%08x\n",
-		i2c_dev->saved_control, i2c_dev->saved_prescaler);
+	mutex_lock(&pm->clk_lock);
+	if (pm->clk_prepared) {
+		clk_unprepare(i2c_dev->clk);
+		pm->clk_prepared = false;
+		i2c_dev->stats.pm_clk_unprepares++;
+	}
+	mutex_unlock(&pm->clk_lock);
 }
 
-static int i2c_a78_runtime_suspend(struct device *dev)
+static void i2c_a78_pm_unprepare_work(struct work_struct *work)
+{
+	struct i2c_a78_pm_data *pm = container_of(to_delayed_work(work),
+						  struct i2c_a78_pm_data, unprepare_work);
+	struct i2c_a78_dev *i2c_dev = container_of(pm, struct i2c_a78_dev, pm);
+	
+	/* Resume holds clk_lock across its enable, so this cannot race it */
+	mutex_lock(&pm->clk_lock);
+	if (pm->clk_prepared && pm_runtime_status_suspended(i2c_dev->dev)) {
+		clk_unprepare(i2c_dev->clk);
+		pm->clk_prepared = false;
+		i2c_dev->stats.pm_clk_unprepares++;
+		dev_dbg(i2c_dev->dev, "Clock unprepared after %u ms suspended\n",
+			pm->unprepare_ms);
+	}
+	mutex_unlock(&pm->clk_lock);
+}
+
+static void i2c_a78_clk_gate(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	
+	if (!pm->keep_prepared) {
+		clk_disable_unprepare(i2c_dev->clk);
+		return;
+	}
+	
+	clk_disable(i2c_dev->clk);
+	if (pm->unprepare_ms)
+		mod_delayed_work(system_wq, &pm->unprepare_work,
+				 msecs_to_jiffies(pm->unprepare_ms));
+}
+
+static int i2c_a78_clk_ungate(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	int ret;
+	
+	if (!pm->keep_prepared)
+		return clk_prepare_enable(i2c_dev->clk);
+	
+	/* System resume prepares the clock before calling in here */
+	if (pm->irq_safe)
+		return clk_enable(i2c_dev->clk);
+	
+	mutex_lock(&pm->clk_lock);
+	ret = 0;
+	if (!pm->clk_prepared) {
+		ret = clk_prepare(i2c_dev->clk);
+		pm->clk_prepared = !ret;
+	}
+	if (!ret)
+		ret = clk_enable(i2c_dev->clk);
+	mutex_unlock(&pm->clk_lock);
+	
+	return ret;
+}
+
+/*
+ * With arm,idle-clock-hz the input clock may drop while the controller is
+ * suspended. The rate notifier retunes the prescaler both ways, and resume
+ * asks for the rate the controller last ran at, so the bus comes back at
+ * full speed. clk_set_rate() sleeps, so IRQ-safe runtime PM leaves it.
+ */
+static void i2c_a78_clk_set_idle(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	int ret;
+	
+	if (!pm->idle_rate)
+		return;
+	
+	pm->active_rate = clk_get_rate(i2c_dev->clk);
+	ret = clk_set_rate(i2c_dev->clk, pm->idle_rate);
+	if (ret)
+		dev_dbg(i2c_dev->dev, "Failed to lower clock to %lu Hz: %d\n",
+			pm->idle_rate, ret);
+}
+
+static void i2c_a78_clk_set_active(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	int ret;
+	
+	if (!pm->idle_rate || !pm->active_rate)
+		return;
+	
+	ret = clk_set_rate(i2c_dev->clk, pm->active_rate);
+	if (ret)
+		dev_warn(i2c_dev->dev, "Failed to restore clock to %lu Hz: %d\n",
+			 pm->active_rate, ret);
+}
+
+int i2c_a78_runtime_suspend(struct device *dev)
 {
 	struct i2c_a78_dev *i2c_dev = dev_get_drvdata(dev);
 	unsigned long flags;
@@ -43,84 +279,518 @@ static int i2c_a78_runtime_suspend(struct device *dev)
 	i2c_dev->suspended = true;
 	spin_unlock_irqrestore(&i2c_dev->lock, flags);
 	
-	i2c_a78_save_context(i2c_dev);
+	i2c_a78_clk_gate(i2c_dev);
+	i2c_a78_clk_set_idle(i2c_dev);
 	
-	clk_disable_unprepare(i2c_dev->clk);
+	i2c_a78_dma_schedule_release(i2c_dev);
 	
 	dev_dbg(dev, "Runtime suspend completed\n");
 	return 0;
 }
 
-static int i2c_a78_runtime_resume(struct device *dev)
+int i2c_a78_runtime_resume(struct device *dev)
 {
 	struct i2c_a78_dev *i2c_dev = dev_get_drvdata(dev);
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	ktime_t start = ktime_get();
 	unsigned long flags;
+	u32 latency;
 	int ret;
 	
-	ret = clk_prepare_enable(i2c_dev->clk);
+	i2c_a78_clk_set_active(i2c_dev);
+	
+	ret = i2c_a78_clk_ungate(i2c_dev);
 	if (ret) {
 		dev_err(dev, "Failed to enable clock during resume: %d\n", ret);
 		return ret;
 	}
 	
-	udelay(10);
-	
-	i2c_a78_restore_context(i2c_dev);
+	i2c_a78_wait_ready(i2c_dev);
 	
+	/* Under the lock, so a prescaler retuned meanwhile is not lost */
 	spin_lock_irqsave(&i2c_dev->lock, flags);
+	i2c_a78_restore_context(i2c_dev);
 	i2c_dev->suspended = false;
 	spin_unlock_irqrestore(&i2c_dev->lock, flags);
 	
+	latency = ktime_us_delta(ktime_get(), start);
+	pm->resume_us[min_t(int, fls(latency), I2C_A78_PM_RESUME_BUCKETS - 1)]++;
+	i2c_dev->stats.pm_resumes++;
+	
+	/*
+	 * A slower resume than any before may now violate the QoS constraint.
+	 * The controller is being resumed, so a new hold needs no request.
+	 */
+	if (latency > pm->resume_max_us) {
+		pm->resume_max_us = latency;
+		i2c_a78_pm_qos_update(i2c_dev);
+	}
+	
 	dev_dbg(dev, "Runtime resume completed\n");
 	return 0;
 }
 
+/*
+ * System sleep runs in the noirq phase, after every client has suspended
+ * and before any of them resumes, so PMICs and other early clients find
+ * the bus usable from their own resume callbacks.
+ */
 int i2c_a78_pm_suspend(struct device *dev)
 {
 	struct i2c_a78_dev *i2c_dev = dev_get_drvdata(dev);
+	ktime_t start = ktime_get();
 	int ret;
 	
+	i2c_mark_adapter_suspended(&i2c_dev->adapter);
+	
 	if (!pm_runtime_status_suspended(dev)) {
 		ret = i2c_a78_runtime_suspend(dev);
-		if (ret)
+		if (ret) {
+			i2c_mark_adapter_resumed(&i2c_dev->adapter);
 			return ret;
+		}
+	}
+	
+	if (i2c_dev->pm.keep_prepared) {
+		cancel_delayed_work_sync(&i2c_dev->pm.unprepare_work);
+		i2c_a78_clk_unprepare(i2c_dev);
 	}
 	
-	dev_dbg(dev, "System suspend completed\n");
+	i2c_dev->stats.sys_suspends++;
+	i2c_dev->stats.sys_suspend_us = ktime_us_delta(ktime_get(), start);
+	
+	dev_dbg(dev, "System suspend completed in %u us\n",
+		i2c_dev->stats.sys_suspend_us);
 	return 0;
 }
 
 int i2c_a78_pm_resume(struct device *dev)
 {
 	struct i2c_a78_dev *i2c_dev = dev_get_drvdata(dev);
+	ktime_t start = ktime_get();
 	int ret;
 	
+	if (i2c_dev->pm.keep_prepared) {
+		ret = i2c_a78_clk_prepare(i2c_dev);
+		if (ret)
+			return ret;
+	}
+	
+	/*
+	 * Always power up: clients resume after us and may transfer at once.
+	 * A controller that was runtime suspended before the system went down
+	 * is now active, so tell the PM core; complete() lets it idle again.
+	 */
 	ret = i2c_a78_runtime_resume(dev);
 	if (ret)
 		return ret;
 	
-	if (!pm_runtime_status_suspended(dev)) {
-		pm_runtime_mark_last_busy(dev);
-		pm_request_autosuspend(dev);
+	if (pm_runtime_status_suspended(dev))
+		pm_runtime_set_active(dev);
+	
+	i2c_mark_adapter_resumed(&i2c_dev->adapter);
+	
+	i2c_dev->stats.sys_resume_us = ktime_us_delta(ktime_get(), start);
+	i2c_dev->stats.sys_resume_max_us = max(i2c_dev->stats.sys_resume_max_us,
+					       i2c_dev->stats.sys_resume_us);
+	
+	dev_dbg(dev, "System resume completed in %u us\n",
+		i2c_dev->stats.sys_resume_us);
+	return 0;
+}
+
+void i2c_a78_pm_complete(struct device *dev)
+{
+	/* Runtime PM is enabled again; suspend if no client needs the bus */
+	pm_runtime_mark_last_busy(dev);
+	pm_request_autosuspend(dev);
+}
+
+/*
+ * Called before the runtime PM reference is taken, so that the gap can be
+ * compared with what the fixed delay would have done to it.
+ */
+static void i2c_a78_pm_busy(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	bool suspended;
+	s64 gap_ms;
+	int b;
+	
+	if (!pm->last_idle)
+		return;
+	
+	gap_ms = ktime_ms_delta(ktime_get(), pm->last_idle);
+	suspended = pm_runtime_status_suspended(i2c_dev->dev);
+	
+	if (!suspended && gap_ms >= I2C_A78_PM_SUSPEND_DELAY_MS)
+		i2c_dev->stats.pm_resumes_avoided++;
+	else if (suspended && gap_ms < I2C_A78_PM_SUSPEND_DELAY_MS)
+		i2c_dev->stats.pm_resumes_added++;
+	
+	b = min_t(int, fls(min_t(s64, gap_ms, U32_MAX)), I2C_A78_PM_GAP_BUCKETS - 1);
+	pm->gaps[b]++;
+	
+	/* Halve the history regularly so the delay follows the workload */
+	if (++pm->samples >= I2C_A78_PM_GAP_WINDOW) {
+		for (b = 0; b < I2C_A78_PM_GAP_BUCKETS; b++)
+			pm->gaps[b] /= 2;
+		pm->samples = 0;
+	}
+	
+	pm->delay_ms = i2c_a78_pm_best_delay(pm->gaps, pm->delay_min_ms,
+					     max(pm->delay_max_ms, pm->delay_min_ms),
+					     pm->break_even_ms);
+}
+
+/* Hand the burst reference back to the PM core. Called with the bus locked. */
+static void i2c_a78_pm_drop(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	u32 delay;
+	
+	if (pm->delay_ms != pm->applied_ms) {
+		delay = pm->delay_ms > I2C_A78_PM_BATCH_MS ?
+			pm->delay_ms - I2C_A78_PM_BATCH_MS : 0;
+		pm_runtime_set_autosuspend_delay(i2c_dev->dev, delay);
+		pm->applied_ms = pm->delay_ms;
+	}
+	
+	pm_runtime_mark_last_busy(i2c_dev->dev);
+	pm_runtime_put_autosuspend(i2c_dev->dev);
+	pm->held = false;
+	i2c_dev->stats.pm_releases++;
+}
+
+/*
+ * Back-to-back transfers share one runtime PM reference. The first
+ * transfer of a burst resumes the controller and keeps its reference,
+ * later ones find it held and touch neither the PM core lock nor
+ * last_busy. The reference is dropped, and last_busy marked once, after
+ * the bus has been idle for I2C_A78_PM_BATCH_MS. The delay handed to the
+ * PM core is shortened by that window, so the controller still suspends
+ * the learned delay after the last transfer. The bus is only tried: a
+ * session or stream can hold it for long, and the worker must not wait
+ * that out. Whoever holds it puts or releases the reference when done,
+ * and the retry covers any other holder.
+ */
+static void i2c_a78_pm_release_work(struct work_struct *work)
+{
+	struct i2c_a78_pm_data *pm = container_of(to_delayed_work(work),
+						  struct i2c_a78_pm_data, release_work);
+	struct i2c_a78_dev *i2c_dev = container_of(pm, struct i2c_a78_dev, pm);
+	s64 idle;
+	
+	if (!i2c_trylock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER)) {
+		schedule_delayed_work(&pm->release_work,
+				      msecs_to_jiffies(I2C_A78_PM_BATCH_MS));
+		return;
+	}
+	
+	if (!pm->held)
+		goto out;
+	
+	idle = ktime_ms_delta(ktime_get(), pm->last_idle);
+	if (idle < I2C_A78_PM_BATCH_MS) {
+		schedule_delayed_work(&pm->release_work,
+				      msecs_to_jiffies(I2C_A78_PM_BATCH_MS - idle));
+		goto out;
+	}
+	
+	i2c_a78_pm_drop(i2c_dev);
+	
+out:
+	i2c_unlock_bus(&i2c_dev->adapter, I2C_LOCK_ROOT_ADAPTER);
+}
+
+/*
+ * A client hint that a transfer is due at some time arms hint_timer to
+ * resume the controller ahead of it, by the slowest resume seen so far
+ * plus I2C_A78_PM_HINT_SLACK_US. The resume holds a runtime PM reference
+ * that the next transfer takes over. If no transfer has come
+ * I2C_A78_PM_HINT_WINDOW_US after the due time, the reference is dropped
+ * again. As with the QoS hold, only the usage count changes under the
+ * lock and the resume or suspend is requested afterwards.
+ */
+static enum hrtimer_restart i2c_a78_pm_hint_timer(struct hrtimer *timer)
+{
+	struct i2c_a78_pm_data *pm = container_of(timer, struct i2c_a78_pm_data,
+						  hint_timer);
+	struct i2c_a78_dev *i2c_dev = container_of(pm, struct i2c_a78_dev, pm);
+	enum hrtimer_restart restart = HRTIMER_NORESTART;
+	enum i2c_a78_hint_state state;
+	bool missed = false;
+	unsigned long flags;
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	
+	state = pm->hint_state;
+	pm->hint_state = i2c_a78_hint_fire(state);
+	if (state == I2C_A78_HINT_ARMED) {
+		pm_runtime_get_noresume(i2c_dev->dev);
+		hrtimer_set_expires(timer, ktime_add_us(pm->hint_at,
+							I2C_A78_PM_HINT_WINDOW_US));
+		restart = HRTIMER_RESTART;
+	} else if (state == I2C_A78_HINT_RESUMED) {
+		i2c_dev->stats.pm_hint_misses++;
+		missed = true;
+		pm_runtime_mark_last_busy(i2c_dev->dev);
+		pm_runtime_put_noidle(i2c_dev->dev);
+	}
+	
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	if (restart == HRTIMER_RESTART)
+		pm_request_resume(i2c_dev->dev);
+	else if (missed)
+		pm_request_autosuspend(i2c_dev->dev);
+	
+	return restart;
+}
+
+/**
+ * i2c_a78_pm_hint - Resume the controller ahead of an expected transfer
+ * @i2c_dev: I2C device structure
+ * @when: Time the transfer is due
+ *
+ * Replaces any earlier hint. Must not be called from hard IRQ context.
+ */
+void i2c_a78_pm_hint(struct i2c_a78_dev *i2c_dev, ktime_t when)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	u32 cost = i2c_a78_pm_resume_cost(pm->resume_max_us);
+	unsigned long flags;
+	ktime_t expires;
+	
+	hrtimer_cancel(&pm->hint_timer);
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	
+	pm->hint_at = when;
+	pm->hint_state = i2c_a78_hint_arm(pm->hint_state);
+	if (pm->hint_state == I2C_A78_HINT_RESUMED) {
+		/* Already up for an earlier hint, only move the deadline */
+		expires = ktime_add_us(when, I2C_A78_PM_HINT_WINDOW_US);
+	} else {
+		expires = ktime_sub_us(when, cost + I2C_A78_PM_HINT_SLACK_US);
 	}
+	i2c_dev->stats.pm_hints++;
+	
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+	
+	hrtimer_start(&pm->hint_timer, expires, HRTIMER_MODE_ABS);
+}
+
+/*
+ * The transfer has its own reference by now, so dropping the one taken
+ * for the hint cannot let the controller suspend.
+ */
+static void i2c_a78_pm_hint_consume(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	unsigned long flags;
+	
+	hrtimer_try_to_cancel(&pm->hint_timer);
+	
+	spin_lock_irqsave(&i2c_dev->lock, flags);
+	
+	if (pm->hint_state == I2C_A78_HINT_RESUMED) {
+		i2c_dev->stats.pm_hint_hits++;
+		pm_runtime_put_noidle(i2c_dev->dev);
+	} else if (pm->hint_state == I2C_A78_HINT_ARMED) {
+		i2c_dev->stats.pm_hint_early++;
+	}
+	pm->hint_state = I2C_A78_HINT_IDLE;
+	
+	spin_unlock_irqrestore(&i2c_dev->lock, flags);
+}
+
+/**
+ * i2c_a78_pm_get - Make sure the controller is resumed for a transfer
+ * @i2c_dev: I2C device structure
+ *
+ * Must be called with the bus locked. Within a burst the reference taken
+ * by the first transfer is still held and nothing else is needed.
+ *
+ * Returns: 0 on success, negative error code if the resume failed
+ */
+int i2c_a78_pm_get(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	int ret;
+	
+	i2c_a78_pm_busy(i2c_dev);
+	
+	if (pm->held) {
+		i2c_dev->stats.pm_fast_gets++;
+	} else {
+		ret = pm_runtime_get_sync(i2c_dev->dev);
+		if (ret < 0) {
+			pm_runtime_put_noidle(i2c_dev->dev);
+			return ret;
+		}
+		
+		pm->held = true;
+		i2c_dev->stats.pm_slow_gets++;
+	}
+	
+	if (READ_ONCE(pm->hint_state) != I2C_A78_HINT_IDLE)
+		i2c_a78_pm_hint_consume(i2c_dev);
 	
-	dev_dbg(dev, "System resume completed\n");
 	return 0;
 }
 
+/**
+ * i2c_a78_pm_put - Mark the end of a transfer
+ * @i2c_dev: I2C device structure
+ *
+ * Must be called with the bus locked. Starts the next idle gap and arms
+ * the release of the burst reference unless it is already armed.
+ */
+void i2c_a78_pm_put(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	
+	pm->last_idle = ktime_get();
+	
+	if (!delayed_work_pending(&pm->release_work))
+		schedule_delayed_work(&pm->release_work,
+				      msecs_to_jiffies(I2C_A78_PM_BATCH_MS));
+}
+
+/**
+ * i2c_a78_pm_claim - Keep the controller resumed for a long bus hold
+ * @i2c_dev: I2C device structure
+ *
+ * Like i2c_a78_pm_get(), for sessions and streams that keep the bus
+ * locked beyond a burst. A release armed by an earlier transfer is
+ * disarmed, since it could only retry until the hold ends. The hold ends
+ * with i2c_a78_pm_put() or i2c_a78_pm_release().
+ *
+ * Returns: 0 on success, negative error code if the resume failed
+ */
+int i2c_a78_pm_claim(struct i2c_a78_dev *i2c_dev)
+{
+	int ret;
+	
+	ret = i2c_a78_pm_get(i2c_dev);
+	if (!ret)
+		cancel_delayed_work(&i2c_dev->pm.release_work);
+	
+	return ret;
+}
+
+/**
+ * i2c_a78_pm_release - Drop the burst reference now
+ * @i2c_dev: I2C device structure
+ *
+ * For a session that ends or expires. Its bus lock is held throughout, so
+ * the reference is handed back here rather than by the release worker,
+ * and the controller suspends on the learned delay even while an expired
+ * session still holds the bus.
+ */
+void i2c_a78_pm_release(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	
+	pm->last_idle = ktime_get();
+	
+	if (pm->held)
+		i2c_a78_pm_drop(i2c_dev);
+}
+
 int i2c_a78_pm_init(struct i2c_a78_dev *i2c_dev)
 {
 	struct device *dev = i2c_dev->dev;
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	u32 settle_us, idle_hz;
+	int ret;
 	
+	pm->settle_us = i2c_dev->variant->resume_settle_us;
+	if (!of_property_read_u32(dev->of_node, "arm,resume-settle-us", &settle_us))
+		pm->settle_us = min_t(u32, settle_us, INT_MAX);
+	
+	mutex_init(&pm->clk_lock);
+	INIT_DELAYED_WORK(&pm->unprepare_work, i2c_a78_pm_unprepare_work);
+	hrtimer_init(&pm->hint_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	pm->hint_timer.function = i2c_a78_pm_hint_timer;
+	pm->clk_prepared = true;
+	pm->keep_prepared = of_property_read_bool(dev->of_node, "arm,keep-clock-prepared");
+	pm->unprepare_ms = I2C_A78_PM_UNPREPARE_MS;
+	of_property_read_u32(dev->of_node, "arm,clock-unprepare-ms", &pm->unprepare_ms);
+	pm->irq_safe = pm->keep_prepared && !pm->unprepare_ms;
+	
+	if (!of_property_read_u32(dev->of_node, "arm,idle-clock-hz", &idle_hz)) {
+		if (pm->irq_safe)
+			dev_warn(dev, "arm,idle-clock-hz ignored with IRQ-safe runtime PM\n");
+		else
+			pm->idle_rate = idle_hz;
+	}
+	
+	pm->delay_min_ms = I2C_A78_PM_DELAY_MIN_MS;
+	pm->delay_max_ms = I2C_A78_PM_DELAY_MAX_MS;
+	pm->break_even_ms = I2C_A78_PM_BREAK_EVEN_MS;
+	pm->delay_ms = I2C_A78_PM_SUSPEND_DELAY_MS;
+	pm->applied_ms = pm->delay_ms;
+	INIT_DELAYED_WORK(&pm->release_work, i2c_a78_pm_release_work);
+	
+	if (pm->irq_safe)
+		pm_runtime_irq_safe(dev);
 	pm_runtime_use_autosuspend(dev);
-	pm_runtime_set_autosuspend_delay(dev, I2C_A78_PM_SUSPEND_DELAY_MS);
+	pm_runtime_set_autosuspend_delay(dev, pm->applied_ms - I2C_A78_PM_BATCH_MS);
 	pm_runtime_set_active(dev);
 	pm_runtime_enable(dev);
 	
+	device_enable_async_suspend(dev);
+	
+	/* Probe drops it as the first burst reference once the adapter is up */
 	pm_runtime_get_noresume(dev);
+	pm->held = true;
 	
-	dev_info(dev, "Power management initialized (autosuspend=%dms)\n",
-		 I2C_A78_PM_SUSPEND_DELAY_MS);
+	/* Lets userspace set a limit through power/pm_qos_resume_latency_us */
+	ret = dev_pm_qos_expose_latency_limit(dev, PM_QOS_RESUME_LATENCY_NO_CONSTRAINT);
+	if (ret)
+		dev_warn(dev, "Failed to expose PM QoS latency limit: %d\n", ret);
+	
+	pm->qos_nb.notifier_call = i2c_a78_pm_qos_notify;
+	pm->qos_latency_us = dev_pm_qos_read_value(dev, DEV_PM_QOS_RESUME_LATENCY);
+	ret = dev_pm_qos_add_notifier(dev, &pm->qos_nb, DEV_PM_QOS_RESUME_LATENCY);
+	if (ret)
+		dev_warn(dev, "Failed to register PM QoS notifier: %d\n", ret);
+	else
+		i2c_a78_pm_qos_update(i2c_dev);
+	
+	dev_info(dev, "Power management initialized (autosuspend=%ums, adaptive %u-%ums, clock %s)\n",
+		 pm->applied_ms, pm->delay_min_ms, pm->delay_max_ms,
+		 !pm->keep_prepared ? "unprepared" :
+		 pm->irq_safe ? "gated, IRQ-safe" : "gated");
 	
 	return 0;
-}
\ No newline at end of file
+}
+
+void i2c_a78_pm_exit(struct i2c_a78_dev *i2c_dev)
+{
+	struct i2c_a78_pm_data *pm = &i2c_dev->pm;
+	
+	dev_pm_qos_remove_notifier(i2c_dev->dev, &pm->qos_nb, DEV_PM_QOS_RESUME_LATENCY);
+	dev_pm_qos_hide_latency_limit(i2c_dev->dev);
+	if (pm->qos_hold)
+		pm_runtime_put_noidle(i2c_dev->dev);
+	pm->qos_hold = false;
+	
+	hrtimer_cancel(&pm->hint_timer);
+	if (pm->hint_state == I2C_A78_HINT_RESUMED)
+		pm_runtime_put_noidle(i2c_dev->dev);
+	pm->hint_state = I2C_A78_HINT_IDLE;
+	
+	cancel_delayed_work_sync(&pm->release_work);
+	if (pm->held)
+		pm_runtime_put_noidle(i2c_dev->dev);
+	pm->held = false;
+	
+	/* Leave the clock prepared and enabled for remove to turn off */
+	cancel_delayed_work_sync(&pm->unprepare_work);
+	pm_runtime_get_sync(i2c_dev->dev);
+	pm_runtime_disable(i2c_dev->dev);
+	pm_runtime_put_noidle(i2c_dev->dev);
+}
@@ -0,0 +1,471 @@
+#ifndef __I2C_A78_CALC_H__
+#define __I2C_A78_CALC_H__
+
+/*
+ * Pure helpers of the I2C A78 driver: timing arithmetic, bounce buffer
+ * layout, resource selection and the decisions of the PM code. They take
+ * plain values and touch no hardware, so the host tests build them from
+ * this file. Included by i2c-a78.h, and by the tests, after the register
+ * and tuning constants.
+ */
+
+#ifdef __KERNEL__
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/i2c.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/minmax.h>
+#include <linux/pm_qos.h>
+#endif
+
+enum i2c_a78_hint_state {
+	I2C_A78_HINT_IDLE,
+	I2C_A78_HINT_ARMED,
+	I2C_A78_HINT_RESUMED,
+};
+
+enum i2c_a78_session_state {
+	I2C_A78_SESSION_OPEN,
+	I2C_A78_SESSION_EXPIRED,
+	I2C_A78_SESSION_CLOSED,
+};
+
+/*
+ * Writable configuration registers held in the software context. All of
+ * them reset to 0, so only registers with a non-zero shadow need to be
+ * rewritten after the controller has lost power.
+ */
+#define I2C_A78_CTX_NREGS	(I2C_A78_FIFO_THRESH / 4 + 1)
+#define I2C_A78_CTX_REGS	(BIT(I2C_A78_CONTROL / 4) | BIT(I2C_A78_PRESCALER / 4) | \
+				 BIT(I2C_A78_FIFO_THRESH / 4))
+
+/**
+ * struct i2c_a78_ctx - Software shadow of the configuration registers
+ * @regs: Last value written to each register in I2C_A78_CTX_REGS,
+ *	indexed by register offset / 4
+ * @dirty: Registers whose shadow differs from their reset value
+ */
+struct i2c_a78_ctx {
+	u32 regs[I2C_A78_CTX_NREGS];
+	u32 dirty;
+};
+
+/* Registers outside I2C_A78_CTX_REGS are not part of the context */
+static inline void i2c_a78_ctx_set(struct i2c_a78_ctx *ctx, u32 value, u32 offset)
+{
+	unsigned int idx = offset / 4;
+	
+	if (offset % 4 || idx >= I2C_A78_CTX_NREGS || !(I2C_A78_CTX_REGS & BIT(idx)))
+		return;
+	
+	ctx->regs[idx] = value;
+	if (value)
+		ctx->dirty |= BIT(idx);
+	else
+		ctx->dirty &= ~BIT(idx);
+}
+
+/*
+ * Registers to rewrite on restore before CONTROL, which goes last so the
+ * controller is only enabled once it is fully configured.
+ */
+static inline u32 i2c_a78_ctx_restore_mask(const struct i2c_a78_ctx *ctx)
+{
+	return ctx->dirty & I2C_A78_CTX_REGS & ~BIT(I2C_A78_CONTROL / 4);
+}
+
+/*
+ * I2C specification minimums per speed mode for SCL LOW, SCL HIGH, data
+ * setup and the bus-free time between STOP and START, and the maximum SCL
+ * rise and fall times assumed when the board gives none. High-speed mode
+ * defines no bus-free time of its own; its tLOW stands in.
+ */
+struct i2c_a78_scl_spec {
+	u32 freq;
+	u32 low_ns;
+	u32 high_ns;
+	u32 su_dat_ns;
+	u32 buf_ns;
+	u32 rise_ns;
+	u32 fall_ns;
+};
+
+static inline const struct i2c_a78_scl_spec *i2c_a78_scl_spec(u32 bus_freq)
+{
+	static const struct i2c_a78_scl_spec specs[] = {
+		{ I2C_A78_SPEED_STD,		4700,	4000,	250,	4700,	1000,	300 },
+		{ I2C_A78_SPEED_FAST,		1300,	600,	100,	1300,	300,	300 },
+		{ I2C_A78_SPEED_FAST_PLUS,	500,	260,	50,	500,	120,	120 },
+		{ I2C_A78_SPEED_HIGH,		160,	60,	10,	160,	40,	40 },
+	};
+	unsigned int i;
+	
+	for (i = 0; i < ARRAY_SIZE(specs) - 1; i++)
+		if (bus_freq <= specs[i].freq)
+			break;
+	
+	return &specs[i];
+}
+
+/**
+ * i2c_a78_scl_calc - Compute the PRESCALER value for a bus
+ * @t: Bus timings, with the edges defaulted from the speed mode
+ * @bus_free_ns: Bus-free time between STOP and START
+ * @clk_rate: Input clock rate in Hz
+ * @prescaler: Returns HIGH_PERIOD and LOW_PERIOD in PRESCALER layout
+ * @actual: Returns the SCL frequency the value gives
+ *
+ * HIGH_PERIOD counts input clock cycles from the moment the controller
+ * sees SCL high, LOW_PERIOD from the moment it pulls SCL low, so one SCL
+ * period is both counts plus the rise, fall and input delay. The counts
+ * start from the specification minimums, LOW also covering the bus-free
+ * time, SDA hold, SDA fall and data setup. Whatever the nominal period
+ * leaves over is shared in proportion, rounding so that the bus never
+ * runs above bus_freq_hz.
+ *
+ * Returns: 0, or -EINVAL when there is no input clock to count
+ */
+static inline int i2c_a78_scl_calc(const struct i2c_timings *t, u32 bus_free_ns,
+				   unsigned long clk_rate, u32 *prescaler, u32 *actual)
+{
+	const struct i2c_a78_scl_spec *spec = i2c_a78_scl_spec(t->bus_freq_hz);
+	u32 edges_ns, period_ns, low_ns, min_low, min_high, total, high, low;
+	
+	if (!clk_rate || !t->bus_freq_hz)
+		return -EINVAL;
+	
+	edges_ns = t->scl_rise_ns + t->scl_fall_ns + t->scl_int_delay_ns;
+	period_ns = DIV_ROUND_UP(NSEC_PER_SEC, t->bus_freq_hz);
+	low_ns = max_t(u32, max_t(u32, spec->low_ns, bus_free_ns),
+		       t->sda_hold_ns + t->sda_fall_ns + spec->su_dat_ns);
+	
+	min_low = DIV_ROUND_UP_ULL((u64)low_ns * clk_rate, NSEC_PER_SEC);
+	min_high = DIV_ROUND_UP_ULL((u64)spec->high_ns * clk_rate, NSEC_PER_SEC);
+	total = period_ns > edges_ns ?
+		DIV_ROUND_UP_ULL((u64)(period_ns - edges_ns) * clk_rate, NSEC_PER_SEC) : 0;
+	
+	/* An input clock or bus too slow for bus_freq_hz runs at the minimums */
+	if (total < min_low + min_high)
+		total = min_low + min_high;
+	
+	high = min_high + (u64)(total - min_low - min_high) * min_high / (min_low + min_high);
+	high = clamp_t(u32, high, 1, 0xFFFF);
+	low = clamp_t(u32, total - high, 1, 0xFFFF);
+	
+	*actual = div64_u64((u64)clk_rate * NSEC_PER_SEC,
+			    (u64)(high + low) * NSEC_PER_SEC + (u64)edges_ns * clk_rate);
+	*prescaler = (high << I2C_A78_PRESCALER_HIGH_SHIFT) | low;
+	
+	return 0;
+}
+
+/*
+ * Messages that do not fit in the bounce buffer are streamed through it
+ * in I2C_A78_DMA_SLOTS chunks, each in its own slot. A TX tail starts
+ * part way into a chunk, right after the body bytes in the same slot.
+ */
+static inline size_t i2c_a78_dma_chunk_len(size_t buf_len, size_t len)
+{
+	if (len <= buf_len)
+		return len;
+	
+	return buf_len / I2C_A78_DMA_SLOTS;
+}
+
+static inline size_t i2c_a78_dma_slot_offset(size_t base, size_t chunk, size_t pos)
+{
+	return base + ((pos / chunk) % I2C_A78_DMA_SLOTS) * chunk + pos % chunk;
+}
+
+/*
+ * A message can be staged while another is on the bus when both fit in
+ * half of the bounce buffer; it goes in the half the other is not using.
+ */
+static inline bool i2c_a78_dma_can_stage(size_t half, size_t cur_len, size_t len)
+{
+	return cur_len <= half && len <= half;
+}
+
+static inline size_t i2c_a78_dma_stage_base(size_t half, size_t cur_base)
+{
+	return cur_base ? 0 : half;
+}
+
+/*
+ * A cached descriptor moves a fixed range of the bounce buffer at a fixed
+ * burst, with or without a completion interrupt, so it is reused only for
+ * a transfer that matches it in all four.
+ */
+struct i2c_a78_dma_desc_key {
+	size_t offset;
+	size_t len;
+	u32 burst;
+	bool polled;
+};
+
+static inline bool i2c_a78_dma_desc_match(const struct i2c_a78_dma_desc_key *a,
+					  const struct i2c_a78_dma_desc_key *b)
+{
+	return a->offset == b->offset && a->len == b->len &&
+	       a->burst == b->burst && a->polled == b->polled;
+}
+
+/*
+ * A DMA message is worth polling for when its estimated bus time, nine
+ * clocks per byte plus the address byte, is below @poll_us; 0 disables.
+ */
+static inline bool i2c_a78_dma_poll_fits(size_t len, u32 bus_freq, u32 poll_us)
+{
+	u64 bus_ns;
+	
+	if (!poll_us)
+		return false;
+	
+	bus_ns = div_u64((u64)(len + 1) * 9 * NSEC_PER_SEC, bus_freq);
+	
+	return bus_ns < (u64)poll_us * NSEC_PER_USEC;
+}
+
+/* @threshold holds the PIO/DMA crossover for writes, then for reads */
+static inline bool i2c_a78_dma_msg_wanted(const u32 *threshold,
+					  const struct i2c_msg *msg)
+{
+	return msg->len && msg->len >= threshold[!!(msg->flags & I2C_M_RD)];
+}
+
+/*
+ * Burst for a DMA segment of @len bytes: @max_burst, or the largest power
+ * of two not above @len for a shorter segment. The body of the segment,
+ * a whole number of bursts, is moved at that burst; the tail returned by
+ * i2c_a78_dma_tail() would never reach the RX watermark nor fill a TX
+ * request of that size, and is moved separately.
+ */
+static inline u32 i2c_a78_dma_body_burst(u32 max_burst, size_t len)
+{
+	u32 burst = max_burst;
+	
+	while (burst > 1 && burst > len)
+		burst >>= 1;
+	
+	return burst;
+}
+
+static inline size_t i2c_a78_dma_tail(u32 burst, size_t len)
+{
+	return len & (burst - 1);
+}
+
+/*
+ * Length of the run of DMA-eligible, same-direction messages starting at
+ * @msgs, at most I2C_A78_DMA_MAX_SEGS; 1 if the first is not eligible.
+ * Only the last segment of a run may end in a partial burst, so a
+ * message that is not a whole number of @max_burst bursts ends the run.
+ */
+static inline int i2c_a78_dma_run_len(const u32 *threshold, const u32 *max_burst,
+				      const struct i2c_msg *msgs, int num)
+{
+	bool read = msgs[0].flags & I2C_M_RD;
+	int n;
+	
+	if (!i2c_a78_dma_msg_wanted(threshold, &msgs[0]))
+		return 1;
+	
+	for (n = 1; n < num && n < I2C_A78_DMA_MAX_SEGS; n++) {
+		if (i2c_a78_dma_tail(max_burst[read], msgs[n - 1].len))
+			break;
+		if (!i2c_a78_dma_msg_wanted(threshold, &msgs[n]))
+			break;
+		if ((msgs[n].flags ^ msgs[0].flags) & I2C_M_RD)
+			break;
+	}
+	
+	return n;
+}
+
+enum i2c_a78_seg_action {
+	I2C_A78_SEG_NONE,
+	I2C_A78_SEG_NEXT,
+	I2C_A78_SEG_DONE,
+};
+
+/*
+ * What a TX_DONE or RX_READY interrupt calls for: nothing after an error,
+ * which has been reported already, nor between the segments of a stream,
+ * where SCL is stretched; the address phase of the next segment of a
+ * scatter-gather batch; otherwise the end of the controller's part.
+ */
+static inline enum i2c_a78_seg_action i2c_a78_seg_action(bool error, bool stream,
+							 int msg_idx, int batch_end)
+{
+	if (error || stream)
+		return I2C_A78_SEG_NONE;
+	
+	return msg_idx + 1 < batch_end ? I2C_A78_SEG_NEXT : I2C_A78_SEG_DONE;
+}
+
+/*
+ * A message completes once every event in @mask has been seen. True only
+ * for the event that completes it, given the events seen before, @old, so
+ * that exactly one of the DMA callback and the controller interrupt wakes
+ * the transfer thread.
+ */
+static inline bool i2c_a78_events_complete(u32 mask, u32 old, u32 event)
+{
+	return (old & mask) != mask && ((old | event) & mask) == mask;
+}
+
+/* @head segments submitted and @tail retired, both free-running */
+static inline bool i2c_a78_stream_full(unsigned int head, unsigned int tail)
+{
+	return head - tail == I2C_A78_STREAM_DEPTH;
+}
+
+/*
+ * Time to wait for a stream segment of @len bytes: the transfer timeout
+ * plus the segment's own time on the bus, nine clocks per byte.
+ */
+static inline u32 i2c_a78_stream_seg_ms(u32 timeout_ms, size_t len, u32 bus_freq)
+{
+	return timeout_ms + div_u64((u64)len * 9 * MSEC_PER_SEC, bus_freq);
+}
+
+/* Free buffer to lease from a pool of @count, or -1 if there is none */
+static inline int i2c_a78_dma_pool_pick(u32 busy, unsigned int count)
+{
+	if (!count || busy == GENMASK(count - 1, 0))
+		return -1;
+	
+	return ffz(busy);
+}
+
+/*
+ * Given PIO and DMA times for @n increasing lengths, returns the shortest
+ * length from which DMA is never slower than PIO, walking down from the
+ * longest, or I2C_A78_DMA_THRESHOLD_OFF if DMA is slower at the longest.
+ */
+static inline u32 i2c_a78_dma_crossover(const u16 *lens, const s64 *pio_ns,
+					const s64 *dma_ns, int n)
+{
+	u32 found = I2C_A78_DMA_THRESHOLD_OFF;
+	int i;
+	
+	for (i = n - 1; i >= 0; i--) {
+		if (dma_ns[i] > pio_ns[i])
+			break;
+		found = lens[i];
+	}
+	
+	return found;
+}
+
+/* Channel pair to lease out of @idle: the controller's own, then the lowest */
+static inline int i2c_a78_dma_arb_pick(u32 idle, int own)
+{
+	if (own >= 0 && (idle & BIT(own)))
+		return own;
+	
+	return idle ? (int)__ffs(idle) : -1;
+}
+
+/*
+ * Choosing the autosuspend delay is a ski-rental problem: staying awake
+ * through a gap costs its length in idle power, suspending costs the delay
+ * plus one suspend/resume cycle, worth @break_even_ms of idle power. Each
+ * bucket edge within the bounds is tried as the delay against the gap
+ * histogram and the cheapest one wins. Gaps shorter than the break-even
+ * time keep the controller up, a quiet bus drives the delay to its
+ * minimum.
+ */
+static inline u32 i2c_a78_pm_best_delay(const u32 *gaps, u32 lo_ms, u32 hi_ms,
+					u32 break_even_ms)
+{
+	u64 cost, best_cost = U64_MAX;
+	u32 delay, edge, best = lo_ms;
+	int i, b;
+	
+	for (i = 0; i < I2C_A78_PM_GAP_BUCKETS; i++) {
+		delay = clamp_t(u32, 1U << i, lo_ms, hi_ms);
+		cost = 0;
+		
+		for (b = 0; b < I2C_A78_PM_GAP_BUCKETS; b++) {
+			edge = 1U << b;
+			if (edge <= delay)
+				cost += (u64)gaps[b] * ((edge / 2 + edge) / 2);
+			else
+				cost += (u64)gaps[b] * (delay + break_even_ms);
+		}
+		
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = delay;
+		}
+	}
+	
+	return best;
+}
+
+/* STATUS reads as zero until the controller is clocked and out of reset */
+static inline bool i2c_a78_status_ready(u32 status)
+{
+	return status & I2C_A78_STATUS_FIFO_RX_EMPTY;
+}
+
+/* Worst resume seen so far, or the datasheet figure before the first one */
+static inline u32 i2c_a78_pm_resume_cost(u32 resume_max_us)
+{
+	return resume_max_us ? resume_max_us : I2C_A78_PM_RESUME_COST_US;
+}
+
+static inline bool i2c_a78_pm_qos_hold(s32 latency_us, u32 resume_max_us)
+{
+	return latency_us != PM_QOS_RESUME_LATENCY_NO_CONSTRAINT &&
+	       latency_us < (s32)i2c_a78_pm_resume_cost(resume_max_us);
+}
+
+/*
+ * A resume hint holds a runtime PM reference while, and only while, it is
+ * I2C_A78_HINT_RESUMED. A new hint arms the timer unless the controller
+ * is already up for an earlier one; the timer resumes an armed hint and
+ * drops a resumed one that no transfer took.
+ */
+static inline enum i2c_a78_hint_state i2c_a78_hint_arm(enum i2c_a78_hint_state state)
+{
+	return state == I2C_A78_HINT_RESUMED ? I2C_A78_HINT_RESUMED : I2C_A78_HINT_ARMED;
+}
+
+static inline enum i2c_a78_hint_state i2c_a78_hint_fire(enum i2c_a78_hint_state state)
+{
+	return state == I2C_A78_HINT_ARMED ? I2C_A78_HINT_RESUMED : I2C_A78_HINT_IDLE;
+}
+
+/*
+ * An open session holds the bus lock, a runtime PM reference and any DMA
+ * lease it took. Running past session_max_ms expires it: the reference
+ * goes back to the PM core and the lease is returned at once, but the
+ * bus lock can only be dropped by its owner, on its next call into the
+ * session, which closes it.
+ */
+static inline enum i2c_a78_session_state
+i2c_a78_session_expire_state(enum i2c_a78_session_state state)
+{
+	return state == I2C_A78_SESSION_OPEN ? I2C_A78_SESSION_EXPIRED : state;
+}
+
+static inline enum i2c_a78_session_state
+i2c_a78_session_call_state(enum i2c_a78_session_state state)
+{
+	return state == I2C_A78_SESSION_EXPIRED ? I2C_A78_SESSION_CLOSED : state;
+}
+
+static inline bool i2c_a78_session_holds_power(enum i2c_a78_session_state state)
+{
+	return state == I2C_A78_SESSION_OPEN;
+}
+
+static inline bool i2c_a78_session_holds_bus(enum i2c_a78_session_state state)
+{
+	return state != I2C_A78_SESSION_CLOSED;
+}
+
+#endif /* __I2C_A78_CALC_H__ */
@@ -2,11 +2,19 @@
 #define __I2C_A78_H__
 
 #include <linux/types.h>
+#include <linux/atomic.h>
 #include <linux/i2c.h>
 #include <linux/platform_device.h>
 #include <linux/clk.h>
 #include <linux/dmaengine.h>
 #include <linux/pm_runtime.h>
+#include <linux/pm_qos.h>
+#include <linux/scatterlist.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
 
 #define I2C_A78_DRIVER_NAME	"i2c-a78-platform"
 
@@ -18,6 +26,7 @@
 #define I2C_A78_FIFO_STATUS	0x14
 #define I2C_A78_INTERRUPT	0x18
 #define I2C_A78_PRESCALER	0x1C
+#define I2C_A78_FIFO_THRESH	0x20
 
 #define I2C_A78_CONTROL_MASTER_EN	BIT(0)
 #define I2C_A78_CONTROL_SPEED_STD	(0 << 1)
@@ -55,6 +64,14 @@
 #define I2C_A78_FIFO_STATUS_RX_LEVEL_MASK	(0x1F << 8)
 #define I2C_A78_FIFO_STATUS_RX_LEVEL_SHIFT	8
 
+#define I2C_A78_FIFO_THRESH_TX_MASK	0x7F
+#define I2C_A78_FIFO_THRESH_RX_MASK	(0x7F << 8)
+#define I2C_A78_FIFO_THRESH_RX_SHIFT	8
+
+#define I2C_A78_PRESCALER_LOW_MASK	0xFFFF
+#define I2C_A78_PRESCALER_HIGH_MASK	0xFFFF0000
+#define I2C_A78_PRESCALER_HIGH_SHIFT	16
+
 #define I2C_A78_INT_TX_DONE		BIT(0)
 #define I2C_A78_INT_RX_READY		BIT(1)
 #define I2C_A78_INT_ARB_LOST		BIT(2)
@@ -65,8 +82,36 @@
 
 #define I2C_A78_FIFO_SIZE		16
 #define I2C_A78_DMA_THRESHOLD		32
+#define I2C_A78_DMA_BURST		8
+#define I2C_A78_DMA_SLOTS		2
+#define I2C_A78_DMA_MAX_SEGS		16
+#define I2C_A78_DMA_DESC_CACHE_SIZE	4
+#define I2C_A78_DMA_IDLE_MS		1000
+#define I2C_A78_DMA_BUF_MAX		65536
+#define I2C_A78_DMA_THRESHOLD_OFF	0x10000
+#define I2C_A78_DMA_POOL_MAX		32
+#define I2C_A78_DMA_POOL_BUF_LEN	PAGE_SIZE
+#define I2C_A78_DMA_POLL_US		100
+#define I2C_A78_DMA_ARB_MAX		32
+#define I2C_A78_STREAM_DEPTH		4
+#define I2C_A78_SESSION_MAX_MS		100
 #define I2C_A78_TIMEOUT_MS		1000
 #define I2C_A78_PM_SUSPEND_DELAY_MS	100
+#define I2C_A78_PM_DELAY_MIN_MS		10
+#define I2C_A78_PM_DELAY_MAX_MS		2000
+#define I2C_A78_PM_BREAK_EVEN_MS	200
+#define I2C_A78_PM_GAP_BUCKETS		16
+#define I2C_A78_PM_GAP_WINDOW		64
+#define I2C_A78_PM_BATCH_MS		2
+#define I2C_A78_PM_READY_TIMEOUT_US	50
+#define I2C_A78_PM_RESUME_BUCKETS	12
+#define I2C_A78_PM_RESUME_COST_US	100
+#define I2C_A78_PM_UNPREPARE_MS		5000
+#define I2C_A78_PM_HINT_SLACK_US	50
+#define I2C_A78_PM_HINT_WINDOW_US	2000
+
+#define I2C_A78_EVENT_CTRL_DONE		BIT(0)
+#define I2C_A78_EVENT_DMA_DONE		BIT(1)
 
 enum i2c_a78_speed {
 	I2C_A78_SPEED_STD = 100000,
@@ -75,6 +120,8 @@ enum i2c_a78_speed {
 	I2C_A78_SPEED_HIGH = 3400000,
 };
 
+#include "i2c-a78-calc.h"
+
 enum i2c_a78_state {
 	I2C_A78_STATE_IDLE,
 	I2C_A78_STATE_START,
@@ -84,17 +131,202 @@ enum i2c_a78_state {
 	I2C_A78_STATE_ERROR,
 };
 
+/**
+ * struct i2c_a78_variant - Per-compatible controller parameters
+ * @fifo_size: FIFO depth in bytes
+ * @tx_burst: Default TX FIFO watermark and DMA burst in bytes
+ * @rx_burst: Default RX FIFO watermark and DMA burst in bytes
+ * @resume_settle_us: Fixed wait after enabling the clock on resume, or
+ *	negative to poll for the controller to become ready
+ */
+struct i2c_a78_variant {
+	u32 fifo_size;
+	u32 tx_burst;
+	u32 rx_burst;
+	int resume_settle_us;
+};
+
+struct i2c_a78_dma_desc {
+	struct dma_async_tx_descriptor *desc;
+	struct i2c_a78_dma_desc_key key;
+};
+
+struct i2c_a78_dma_job {
+	struct i2c_msg *msgs;
+	int num;
+	bool read;
+	bool sg;
+	size_t base;
+	size_t chunk;
+	size_t tail;
+	size_t done;
+	bool ok;
+	bool polled;
+	dma_cookie_t cookie;
+};
+
 struct i2c_a78_dma_data {
 	struct dma_chan *tx_chan;
 	struct dma_chan *rx_chan;
-	dma_addr_t tx_dma_buf;
-	dma_addr_t rx_dma_buf;
-	void *tx_buf;
-	void *rx_buf;
+	dma_addr_t dma_buf;
+	void *buf;
+	size_t buf_size;
 	size_t buf_len;
 	struct completion tx_complete;
 	struct completion rx_complete;
+	struct scatterlist sgl[I2C_A78_DMA_MAX_SEGS];
+	u8 *sg_bufs[I2C_A78_DMA_MAX_SEGS];
+	dma_addr_t sg_tail;
+	struct i2c_a78_dma_desc desc_cache[2][I2C_A78_DMA_DESC_CACHE_SIZE];
+	unsigned int desc_victim[2];
+	bool desc_reuse;
+	
+	u32 fifo_size;
+	u32 max_burst[2];
+	u32 burst[2];
+	
+	struct i2c_a78_dma_job jobs[I2C_A78_DMA_SLOTS];
+	unsigned int head;
+	unsigned int tail;
+	struct i2c_a78_dma_job *active;
+	struct i2c_a78_dma_job *next;
+	bool issued_ahead;
+	atomic_t pending;
+	
+	u32 threshold[2];
+	u32 calib_freq[2];
+	int calib_scratch;
+	
+	bool enabled;
+	bool coherent;
 	bool use_dma;
+	bool xfer_dma;
+	bool pooled;
+	int pool_idx;
+	bool borrower;
+	int arb_idx;
+	int arb_lease;
+	u32 idle_ms;
+	ktime_t last_use;
+	struct delayed_work idle_work;
+};
+
+struct i2c_a78_stream_seg {
+	dma_addr_t addr;
+	size_t len;
+};
+
+/**
+ * struct i2c_a78_stream - Open streaming write transaction
+ * @i2c_dev: Controller the stream runs on
+ * @msg: Target address and flags of the single address phase
+ * @segs: Client buffers queued to the DMA engine, used as a ring
+ * @head: Number of segments submitted
+ * @tail: Number of segments retired
+ * @completed: Number of segments the DMA engine has finished
+ * @wait: Woken on segment completion, bus error and abort
+ * @aborted: Set by i2c_a78_stream_abort()
+ */
+struct i2c_a78_stream {
+	struct i2c_a78_dev *i2c_dev;
+	struct i2c_msg msg;
+	struct i2c_a78_stream_seg segs[I2C_A78_STREAM_DEPTH];
+	unsigned int head;
+	unsigned int tail;
+	atomic_t completed;
+	wait_queue_head_t wait;
+	bool aborted;
+};
+
+/**
+ * struct i2c_a78_session - Bus session of one client
+ * @i2c_dev: Controller the session runs on
+ * @lock: Serialises transfers with @expire_work
+ * @expire_work: Expires the session at @deadline
+ * @start: Time the session began
+ * @deadline: Time after which transfers are refused
+ * @xfers: Transfers run in the session
+ * @dma_used: A DMA lease is held until the session ends or expires
+ * @state: What the session still holds, see i2c_a78_session_expire_state()
+ */
+struct i2c_a78_session {
+	struct i2c_a78_dev *i2c_dev;
+	struct mutex lock;
+	struct delayed_work expire_work;
+	ktime_t start;
+	ktime_t deadline;
+	u32 xfers;
+	bool dma_used;
+	enum i2c_a78_session_state state;
+};
+
+/**
+ * struct i2c_a78_pm_data - Adaptive autosuspend state
+ * @last_idle: End of the previous transfer
+ * @gaps: Histogram of idle gaps between transfers; bucket i holds gaps
+ *	of [2^(i-1), 2^i) ms and bucket 0 back-to-back transfers
+ * @samples: Gaps recorded since the histogram was last decayed
+ * @delay_ms: Autosuspend delay learned from @gaps
+ * @applied_ms: Autosuspend delay last handed to the PM core
+ * @delay_min_ms: Lower bound for @delay_ms
+ * @delay_max_ms: Upper bound for @delay_ms
+ * @break_even_ms: Idle time that costs as much as one suspend/resume cycle
+ * @held: A runtime PM reference is held for the current burst of transfers
+ * @release_work: Drops @held once the bus has been idle for
+ *	I2C_A78_PM_BATCH_MS
+ * @settle_us: Wait after enabling the clock on resume, negative to poll
+ * @resume_us: Histogram of runtime resume latency; bucket i holds
+ *	resumes of [2^(i-1), 2^i) us
+ * @resume_max_us: Longest runtime resume
+ * @qos_nb: Notified when the resume latency constraint changes
+ * @qos_latency_us: Current resume latency constraint
+ * @qos_hold: A runtime PM reference is held because of @qos_latency_us
+ * @qos_since: Start of the current QoS hold
+ * @qos_awake_us: Time spent in finished QoS holds
+ * @keep_prepared: Runtime PM only gates the clock, it stays prepared
+ * @irq_safe: Runtime PM callbacks may run in atomic context
+ * @clk_prepared: The clock is prepared
+ * @clk_lock: Serialises clock prepare and unprepare with resume
+ * @unprepare_ms: Runtime suspended time after which the clock is also
+ *	unprepared, 0 to keep it prepared until system suspend
+ * @unprepare_work: Unprepares the clock after @unprepare_ms
+ * @hint_timer: Resumes the controller ahead of a hinted transfer, then
+ *	drops the hint if no transfer came
+ * @hint_state: Progress of the current hint
+ * @hint_at: Time the hinted transfer is due
+ * @idle_rate: Input clock rate while runtime suspended, 0 to leave it
+ * @active_rate: Input clock rate to ask for again on resume
+ */
+struct i2c_a78_pm_data {
+	ktime_t last_idle;
+	u32 gaps[I2C_A78_PM_GAP_BUCKETS];
+	u32 samples;
+	u32 delay_ms;
+	u32 applied_ms;
+	u32 delay_min_ms;
+	u32 delay_max_ms;
+	u32 break_even_ms;
+	bool held;
+	struct delayed_work release_work;
+	int settle_us;
+	u32 resume_us[I2C_A78_PM_RESUME_BUCKETS];
+	u32 resume_max_us;
+	struct notifier_block qos_nb;
+	s32 qos_latency_us;
+	bool qos_hold;
+	ktime_t qos_since;
+	u64 qos_awake_us;
+	bool keep_prepared;
+	bool irq_safe;
+	bool clk_prepared;
+	struct mutex clk_lock;
+	u32 unprepare_ms;
+	struct delayed_work unprepare_work;
+	struct hrtimer hint_timer;
+	enum i2c_a78_hint_state hint_state;
+	ktime_t hint_at;
+	unsigned long idle_rate;
+	unsigned long active_rate;
 };
 
 struct i2c_a78_dev {
@@ -102,24 +334,41 @@ struct i2c_a78_dev {
 	void __iomem *base;
 	struct clk *clk;
 	int irq;
+	const struct i2c_a78_variant *variant;
+	
+	struct notifier_block clk_nb;
+	wait_queue_head_t rate_wait;
+	bool rate_changing;
+	bool xfer_busy;
+	ktime_t rate_change_start;
 	
 	struct i2c_adapter adapter;
 	struct i2c_msg *msgs;
 	int num_msgs;
 	int msg_idx;
+	int batch_end;
 	
 	enum i2c_a78_state state;
 	u32 bus_freq;
+	u32 bus_freq_actual;
+	u32 bus_free_ns;
+	struct i2c_timings timings;
 	u32 timeout_ms;
+	u32 dma_poll_us;
+	bool polling;
+	u32 session_max_ms;
 	
 	spinlock_t lock;
 	struct completion msg_complete;
+	atomic_t events;
+	u32 event_mask;
+	struct i2c_a78_stream *stream;
 	
 	struct i2c_a78_dma_data dma;
 	
 	bool suspended;
-	u32 saved_control;
-	u32 saved_prescaler;
+	struct i2c_a78_ctx ctx;
+	struct i2c_a78_pm_data pm;
 	
 	struct {
 		u64 tx_bytes;
@@ -127,6 +376,50 @@ struct i2c_a78_dev {
 		u32 timeouts;
 		u32 arb_lost;
 		u32 nacks;
+		u32 dma_batches;
+		u32 dma_zero_copy;
+		u32 dma_bounced;
+		u64 dma_desc_hits;
+		u64 dma_desc_misses;
+		u32 dma_issued_ahead;
+		u32 dma_acquires;
+		u32 dma_acquire_us;
+		u32 dma_acquire_max_us;
+		u32 dma_releases;
+		u32 dma_chan_borrows;
+		u32 dma_chan_waits;
+		u64 dma_chan_wait_us;
+		u32 dma_chan_wait_max_us;
+		u32 dma_chan_starved;
+		u32 streams;
+		u32 stream_aborts;
+		u32 sessions;
+		u32 session_xfers;
+		u32 session_expired;
+		u64 session_us;
+		u32 session_max_us;
+		u32 dma_polled;
+		u32 dma_poll_sleeps;
+		u32 pm_resumes;
+		u32 pm_resumes_avoided;
+		u32 pm_resumes_added;
+		u32 pm_fast_gets;
+		u32 pm_slow_gets;
+		u32 pm_releases;
+		u32 pm_ready_timeouts;
+		u32 pm_qos_holds;
+		u32 pm_clk_unprepares;
+		u32 pm_hints;
+		u32 pm_hint_hits;
+		u32 pm_hint_early;
+		u32 pm_hint_misses;
+		u32 sys_suspends;
+		u32 sys_suspend_us;
+		u32 sys_resume_us;
+		u32 sys_resume_max_us;
+		u32 clk_retunes;
+		u64 clk_hold_us;
+		u32 clk_hold_max_us;
 	} stats;
 };
 
@@ -159,12 +452,115 @@ static inline void i2c_a78_writel(struct i2c_a78_dev *i2c_dev, u32 value, u32 of
 	writel_relaxed(value, i2c_dev->base + offset);
 }
 
+/**
+ * i2c_a78_set_ctx - Update the shadow of a configuration register only
+ * @i2c_dev: I2C device structure
+ * @value: Value the register is to hold
+ * @offset: Offset of a register in I2C_A78_CTX_REGS
+ *
+ * For a controller that is runtime suspended; resume programs the value.
+ */
+static inline void i2c_a78_set_ctx(struct i2c_a78_dev *i2c_dev, u32 value, u32 offset)
+{
+	i2c_a78_ctx_set(&i2c_dev->ctx, value, offset);
+}
+
+/**
+ * i2c_a78_write_ctx - Write a configuration register through its shadow
+ * @i2c_dev: I2C device structure
+ * @value: Value to write
+ * @offset: Offset of a register in I2C_A78_CTX_REGS
+ *
+ * Keeps the software context in step with the hardware so that runtime
+ * suspend needs no register reads and resume only rewrites registers that
+ * differ from their reset value.
+ */
+static inline void i2c_a78_write_ctx(struct i2c_a78_dev *i2c_dev, u32 value, u32 offset)
+{
+	i2c_a78_set_ctx(i2c_dev, value, offset);
+	i2c_a78_writel(i2c_dev, value, offset);
+}
+
+/**
+ * i2c_a78_read_ctx - Read a configuration register from its shadow
+ * @i2c_dev: I2C device structure
+ * @offset: Offset of a register in I2C_A78_CTX_REGS
+ *
+ * Returns: the value last written with i2c_a78_write_ctx()
+ */
+static inline u32 i2c_a78_read_ctx(struct i2c_a78_dev *i2c_dev, u32 offset)
+{
+	return i2c_dev->ctx.regs[offset / 4];
+}
+
+/**
+ * i2c_a78_dma_wanted - Check whether a message should be moved by DMA
+ * @i2c_dev: I2C device structure
+ * @msg: Message to check
+ *
+ * Compares the message length with the PIO/DMA crossover threshold for
+ * its direction, which is either the default, a calibrated value or a
+ * manual override.
+ *
+ * Returns: true if the message is long enough for DMA
+ */
+static inline bool i2c_a78_dma_wanted(struct i2c_a78_dev *i2c_dev,
+				      struct i2c_msg *msg)
+{
+	return i2c_a78_dma_msg_wanted(i2c_dev->dma.threshold, msg);
+}
+
 int i2c_a78_dma_init(struct i2c_a78_dev *i2c_dev);
 void i2c_a78_dma_release(struct i2c_a78_dev *i2c_dev);
-int i2c_a78_dma_xfer(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg);
+int i2c_a78_dma_acquire(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_dma_schedule_release(struct i2c_a78_dev *i2c_dev);
+int i2c_a78_dma_calibrate(struct i2c_a78_dev *i2c_dev, u16 addr, bool read);
+int i2c_a78_dma_lease(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_dma_return(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_dma_pool_show(struct seq_file *s);
+void i2c_a78_dma_arb_show(struct seq_file *s);
+int i2c_a78_dma_xfer(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg,
+		     bool polled);
+bool i2c_a78_dma_polled_done(struct i2c_a78_dev *i2c_dev);
+int i2c_a78_dma_xfer_sg(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msgs, int num,
+			bool polled);
+int i2c_a78_dma_finish(struct i2c_a78_dev *i2c_dev, int ret);
+void i2c_a78_dma_prepare_next(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg);
+int i2c_a78_dma_issue_next(struct i2c_a78_dev *i2c_dev);
+
+int i2c_a78_dma_stream_start(struct i2c_a78_stream *stream);
+int i2c_a78_dma_stream_stop(struct i2c_a78_stream *stream);
+
+struct i2c_a78_stream *i2c_a78_stream_open(struct i2c_adapter *adapter,
+					   u16 addr, u16 flags);
+int i2c_a78_stream_write(struct i2c_a78_stream *stream, const void *buf,
+			 size_t len);
+int i2c_a78_stream_flush(struct i2c_a78_stream *stream);
+void i2c_a78_stream_abort(struct i2c_a78_stream *stream);
+int i2c_a78_stream_close(struct i2c_a78_stream *stream);
+
+struct i2c_a78_session *i2c_a78_session_begin(struct i2c_adapter *adapter);
+int i2c_a78_session_xfer(struct i2c_a78_session *session, struct i2c_msg *msgs,
+			 int num);
+void i2c_a78_session_end(struct i2c_a78_session *session);
+
+void i2c_a78_signal_event(struct i2c_a78_dev *i2c_dev, u32 event);
 
 int i2c_a78_pm_init(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_pm_exit(struct i2c_a78_dev *i2c_dev);
+int i2c_a78_pm_get(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_pm_put(struct i2c_a78_dev *i2c_dev);
+int i2c_a78_pm_claim(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_pm_release(struct i2c_a78_dev *i2c_dev);
+u64 i2c_a78_pm_qos_awake_us(struct i2c_a78_dev *i2c_dev);
+void i2c_a78_pm_hint(struct i2c_a78_dev *i2c_dev, ktime_t when);
+int i2c_a78_expect_xfer(struct i2c_adapter *adapter, ktime_t when);
+int i2c_a78_add_latency_request(struct i2c_adapter *adapter,
+				struct dev_pm_qos_request *req, s32 latency_us);
 int i2c_a78_pm_suspend(struct device *dev);
 int i2c_a78_pm_resume(struct device *dev);
+void i2c_a78_pm_complete(struct device *dev);
+int i2c_a78_runtime_suspend(struct device *dev);
+int i2c_a78_runtime_resume(struct device *dev);
 
 #endif /* __I2C_A78_H__ */
\ No newline at end of file
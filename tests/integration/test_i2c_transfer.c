@@ -119,6 +119,567 @@ static int test_dma_threshold(void)
 	return 0;
 }
 
+static int test_dma_large_message_chunking(void)
+{
+	size_t buf_len = PAGE_SIZE;
+	size_t len = 65535;
+	size_t chunk, queued = 0, offset;
+	int chunks = 0;
+	
+	printf("Testing DMA chunking of messages larger than the bounce buffer...\n");
+	
+	// A message that fits goes in one chunk
+	assert(i2c_a78_dma_chunk_len(buf_len, 256) == 256);
+	assert(i2c_a78_dma_chunk_len(buf_len, buf_len) == buf_len);
+	
+	// A u16-sized one is streamed through the slots in turn
+	chunk = i2c_a78_dma_chunk_len(buf_len, len);
+	assert(chunk == buf_len / I2C_A78_DMA_SLOTS);
+	
+	while (queued < len) {
+		size_t this_len = (len - queued < chunk) ? len - queued : chunk;
+		
+		offset = i2c_a78_dma_slot_offset(0, chunk, queued);
+		assert(offset + this_len <= buf_len);
+		assert(offset == (chunks % I2C_A78_DMA_SLOTS) * chunk);
+		
+		queued += this_len;
+		chunks++;
+	}
+	
+	assert(queued == len);
+	assert(chunks == (int)((len + chunk - 1) / chunk));
+	
+	printf("✓ DMA large message chunking test passed (%d chunks)\n", chunks);
+	return 0;
+}
+
+static int test_dma_pipelined_slots(void)
+{
+	size_t half = PAGE_SIZE / I2C_A78_DMA_SLOTS;
+	size_t lens[] = { 256, 1024, half + 952, 64, half };
+	size_t base = 0, prev_base = 0, prev_len = 0;
+	int i, staged = 0;
+	
+	printf("Testing DMA pipelining across messages...\n");
+	
+	// Each message that fits in half the bounce buffer is staged in the
+	// half the message on the bus is not using
+	for (i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++) {
+		if (i > 0 && i2c_a78_dma_can_stage(half, prev_len, lens[i])) {
+			base = i2c_a78_dma_stage_base(half, prev_base);
+			assert(base + lens[i] <= prev_base || prev_base + prev_len <= base);
+			staged++;
+		} else {
+			base = 0;
+		}
+		
+		assert(base + lens[i] <= PAGE_SIZE);
+		prev_base = base;
+		prev_len = lens[i];
+	}
+	
+	assert(staged == 2);
+	
+	printf("✓ DMA pipelined slots test passed (%d staged)\n", staged);
+	return 0;
+}
+
+/*
+ * Replay the queueing of i2c_a78_dma_xfer() for a write and check that the
+ * tail does not land on a body chunk that has not been retired.
+ */
+static void check_tail_placement(size_t buf_len, size_t len)
+{
+	size_t chunk = i2c_a78_dma_chunk_len(buf_len, len);
+	u32 burst = i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, len);
+	size_t tail = i2c_a78_dma_tail(burst, len);
+	size_t body = len - tail;
+	size_t start[64], done = 0, queued = 0, this_len, offset, tail_off;
+	int n = 0, i;
+	
+	while (queued < len) {
+		if (queued - done >= I2C_A78_DMA_SLOTS * chunk)
+			done += chunk;
+		
+		this_len = queued < body ? (body - queued < chunk ? body - queued : chunk) : tail;
+		offset = i2c_a78_dma_slot_offset(0, chunk, queued);
+		assert(offset + this_len <= buf_len);
+		
+		if (queued < body) {
+			assert(n < (int)ARRAY_SIZE(start));
+			start[n++] = queued;
+		} else {
+			tail_off = offset;
+			for (i = 0; i < n; i++) {
+				size_t b_off = i2c_a78_dma_slot_offset(0, chunk, start[i]);
+				size_t b_len = body - start[i] < chunk ? body - start[i] : chunk;
+				
+				if (start[i] + b_len <= done)
+					continue;
+				assert(tail_off >= b_off + b_len || tail_off + tail <= b_off);
+			}
+		}
+		
+		queued += this_len;
+	}
+}
+
+static int test_dma_burst_split(void)
+{
+	const struct {
+		size_t buf_len, len;
+	} tail_cases[] = {
+		{ PAGE_SIZE, 100 }, { PAGE_SIZE, 33 }, { PAGE_SIZE, 4095 },
+		{ PAGE_SIZE, 5001 }, { PAGE_SIZE, 6145 }, { PAGE_SIZE, 8193 },
+		{ PAGE_SIZE, 65535 },
+	};
+	const size_t lens[] = { 64, 4096, 100, 33, 40, 5, 1 };
+	unsigned int thresh;
+	size_t tail;
+	u32 burst;
+	int i;
+	
+	printf("Testing DMA body/tail split against FIFO watermarks...\n");
+	
+	// Aligned lengths are all body, at the full watermark
+	assert(i2c_a78_dma_body_burst(I2C_A78_DMA_BURST, 64) == I2C_A78_DMA_BURST);
+	assert(i2c_a78_dma_tail(I2C_A78_DMA_BURST, 64) == 0);
+	assert(i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, 4096) == I2C_A78_FIFO_SIZE);
+	
+	// An odd length keeps the full burst for its body, the tail is split off
+	assert(i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, 100) == I2C_A78_FIFO_SIZE);
+	assert(i2c_a78_dma_tail(I2C_A78_FIFO_SIZE, 100) == 4);
+	assert(i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, 33) == I2C_A78_FIFO_SIZE);
+	assert(i2c_a78_dma_tail(I2C_A78_FIFO_SIZE, 33) == 1);
+	
+	// Segments shorter than the watermark use the largest burst that fits
+	assert(i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, 5) == 4);
+	assert(i2c_a78_dma_tail(4, 5) == 1);
+	assert(i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, 1) == 1);
+	
+	// The body is never empty and the tail never reaches a burst
+	for (i = 0; i < (int)ARRAY_SIZE(lens); i++) {
+		burst = i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, lens[i]);
+		tail = i2c_a78_dma_tail(burst, lens[i]);
+		
+		assert(tail < burst);
+		assert(lens[i] - tail >= burst);
+		assert((lens[i] - tail) % burst == 0);
+	}
+	
+	// A TX tail goes after the body in the buffer, never over a body
+	// chunk the DMA engine may still be reading
+	for (i = 0; i < (int)ARRAY_SIZE(tail_cases); i++)
+		check_tail_placement(tail_cases[i].buf_len, tail_cases[i].len);
+	
+	// Watermark register layout
+	thresh = (8 & I2C_A78_FIFO_THRESH_TX_MASK) |
+		 ((16 << I2C_A78_FIFO_THRESH_RX_SHIFT) & I2C_A78_FIFO_THRESH_RX_MASK);
+	assert(thresh == 0x1008);
+	
+	printf("✓ DMA body/tail split test passed\n");
+	return 0;
+}
+
+static void desc_key_add(struct i2c_a78_dma_desc_key *seen, int *n,
+			 const struct i2c_a78_dma_desc_key *key)
+{
+	int i;
+	
+	for (i = 0; i < *n; i++)
+		if (i2c_a78_dma_desc_match(&seen[i], key))
+			return;
+	
+	seen[(*n)++] = *key;
+}
+
+static int test_dma_desc_cache_keys(void)
+{
+	size_t half = PAGE_SIZE / I2C_A78_DMA_SLOTS;
+	struct i2c_a78_dma_desc_key seen[8], body, tail_key, polled;
+	size_t len = 100, tail, base = 0;
+	u32 burst;
+	int i, n = 0;
+	
+	printf("Testing DMA descriptor cache keys...\n");
+	
+	// A write's body and its burst-1 tail right behind it never share one
+	burst = i2c_a78_dma_body_burst(I2C_A78_FIFO_SIZE, len);
+	tail = i2c_a78_dma_tail(burst, len);
+	body = (struct i2c_a78_dma_desc_key){ i2c_a78_dma_slot_offset(0, len, 0),
+					      len - tail, burst, false };
+	tail_key = (struct i2c_a78_dma_desc_key){ i2c_a78_dma_slot_offset(0, len, len - tail),
+						  tail, 1, false };
+	assert(i2c_a78_dma_desc_match(&body, &body));
+	assert(!i2c_a78_dma_desc_match(&body, &tail_key));
+	
+	// Nor do the interrupt-driven and polled forms of the same range
+	polled = body;
+	polled.polled = true;
+	assert(!i2c_a78_dma_desc_match(&body, &polled));
+	
+	// Repeated writes staged in alternate halves: a body and a tail per
+	// half, which the cache holds in full
+	for (i = 0; i < 16; i++) {
+		if (i > 0) {
+			assert(i2c_a78_dma_can_stage(half, len, len));
+			base = i2c_a78_dma_stage_base(half, base);
+		}
+		
+		body.offset = i2c_a78_dma_slot_offset(base, len, 0);
+		tail_key.offset = i2c_a78_dma_slot_offset(base, len, len - tail);
+		desc_key_add(seen, &n, &body);
+		desc_key_add(seen, &n, &tail_key);
+	}
+	
+	assert(n == 4);
+	assert(n <= I2C_A78_DMA_DESC_CACHE_SIZE);
+	
+	printf("✓ DMA descriptor cache keys test passed (%d descriptors)\n", n);
+	return 0;
+}
+
+static int test_dma_poll_fits(void)
+{
+	printf("Testing polled DMA completion cut-off...\n");
+	
+	// 0 disables polling
+	assert(!i2c_a78_dma_poll_fits(1, I2C_A78_SPEED_HIGH, 0));
+	
+	// 22.5 us per byte at 400 kHz: three bytes fit 100 us, four do not
+	assert(i2c_a78_dma_poll_fits(3, I2C_A78_SPEED_FAST, I2C_A78_DMA_POLL_US));
+	assert(!i2c_a78_dma_poll_fits(4, I2C_A78_SPEED_FAST, I2C_A78_DMA_POLL_US));
+	
+	// At 3.4 MHz up to 36 bytes do
+	assert(i2c_a78_dma_poll_fits(8, I2C_A78_SPEED_HIGH, I2C_A78_DMA_POLL_US));
+	assert(i2c_a78_dma_poll_fits(36, I2C_A78_SPEED_HIGH, I2C_A78_DMA_POLL_US));
+	assert(!i2c_a78_dma_poll_fits(37, I2C_A78_SPEED_HIGH, I2C_A78_DMA_POLL_US));
+	
+	// At 100 kHz only the 90 us address byte would, and the cut-off is strict
+	assert(i2c_a78_dma_poll_fits(0, I2C_A78_SPEED_STD, I2C_A78_DMA_POLL_US));
+	assert(!i2c_a78_dma_poll_fits(0, I2C_A78_SPEED_STD, 90));
+	assert(!i2c_a78_dma_poll_fits(1, I2C_A78_SPEED_STD, I2C_A78_DMA_POLL_US));
+	
+	printf("✓ Polled DMA completion cut-off test passed\n");
+	return 0;
+}
+
+static int test_dma_sg_batching(void)
+{
+	const u32 threshold[2] = { I2C_A78_DMA_THRESHOLD, I2C_A78_DMA_THRESHOLD };
+	const u32 max_burst[2] = { I2C_A78_DMA_BURST, I2C_A78_DMA_BURST };
+	struct i2c_msg msgs[I2C_A78_DMA_MAX_SEGS + 4];
+	u8 buf[64];
+	int i;
+	
+	printf("Testing DMA scatter-gather batching...\n");
+	
+	for (i = 0; i < (int)ARRAY_SIZE(msgs); i++) {
+		msgs[i].addr = 0x50;
+		msgs[i].flags = 0;
+		msgs[i].len = sizeof(buf);
+		msgs[i].buf = buf;
+	}
+	
+	// A run of long writes is one job, capped at the scatterlist size
+	assert(i2c_a78_dma_run_len(threshold, max_burst, msgs, ARRAY_SIZE(msgs)) == I2C_A78_DMA_MAX_SEGS);
+	assert(i2c_a78_dma_run_len(threshold, max_burst, msgs, 3) == 3);
+	
+	// A change of direction ends the run
+	msgs[2].flags = I2C_M_RD;
+	assert(i2c_a78_dma_run_len(threshold, max_burst, msgs, ARRAY_SIZE(msgs)) == 2);
+	assert(i2c_a78_dma_run_len(threshold, max_burst, &msgs[2], 1) == 1);
+	
+	// So does a message below the threshold, which goes through PIO
+	msgs[2].flags = 0;
+	msgs[1].len = I2C_A78_DMA_THRESHOLD - 1;
+	assert(i2c_a78_dma_run_len(threshold, max_burst, msgs, ARRAY_SIZE(msgs)) == 1);
+	assert(i2c_a78_dma_run_len(threshold, max_burst, &msgs[1], ARRAY_SIZE(msgs) - 1) == 1);
+	
+	// A partial burst may only end a run, where it is split off as a tail
+	msgs[1].len = sizeof(buf) - 1;
+	assert(i2c_a78_dma_run_len(threshold, max_burst, msgs, ARRAY_SIZE(msgs)) == 2);
+	assert(i2c_a78_dma_run_len(threshold, max_burst, &msgs[2], 4) == 4);
+	
+	// Zero-length messages never use DMA, whatever the threshold
+	msgs[1].len = 0;
+	assert(!i2c_a78_dma_msg_wanted(threshold, &msgs[1]));
+	
+	printf("✓ DMA scatter-gather batching test passed\n");
+	return 0;
+}
+
+static int test_dma_sg_sequencing(void)
+{
+	int msg_idx = 0, batch_end = 3, addresses = 1;
+	enum i2c_a78_seg_action action;
+	
+	printf("Testing address phases between scatter-gather segments...\n");
+	
+	// Each segment's end starts the next one's address phase, the last
+	// one's ends the controller's part of the job
+	while ((action = i2c_a78_seg_action(false, false, msg_idx, batch_end)) ==
+	       I2C_A78_SEG_NEXT) {
+		msg_idx++;
+		addresses++;
+	}
+	assert(action == I2C_A78_SEG_DONE);
+	assert(msg_idx == batch_end - 1 && addresses == batch_end);
+	
+	// A single message is done at once
+	assert(i2c_a78_seg_action(false, false, 0, 1) == I2C_A78_SEG_DONE);
+	
+	// After an error, or between stream segments, nothing is sequenced
+	assert(i2c_a78_seg_action(true, false, 0, 3) == I2C_A78_SEG_NONE);
+	assert(i2c_a78_seg_action(false, true, 0, 1) == I2C_A78_SEG_NONE);
+	
+	printf("✓ DMA scatter-gather sequencing test passed\n");
+	return 0;
+}
+
+static int test_completion_events(void)
+{
+	const u32 both = I2C_A78_EVENT_CTRL_DONE | I2C_A78_EVENT_DMA_DONE;
+	
+	printf("Testing completion event mask...\n");
+	
+	// PIO: the controller interrupt alone completes the message
+	assert(i2c_a78_events_complete(I2C_A78_EVENT_CTRL_DONE, 0, I2C_A78_EVENT_CTRL_DONE));
+	
+	// DMA: whichever of the two arrives last wakes the thread, never the first
+	assert(!i2c_a78_events_complete(both, 0, I2C_A78_EVENT_DMA_DONE));
+	assert(i2c_a78_events_complete(both, I2C_A78_EVENT_DMA_DONE, I2C_A78_EVENT_CTRL_DONE));
+	assert(!i2c_a78_events_complete(both, 0, I2C_A78_EVENT_CTRL_DONE));
+	assert(i2c_a78_events_complete(both, I2C_A78_EVENT_CTRL_DONE, I2C_A78_EVENT_DMA_DONE));
+	
+	// A repeated event after completion does not wake it twice
+	assert(!i2c_a78_events_complete(both, both, I2C_A78_EVENT_CTRL_DONE));
+	assert(!i2c_a78_events_complete(I2C_A78_EVENT_CTRL_DONE, I2C_A78_EVENT_CTRL_DONE,
+					I2C_A78_EVENT_CTRL_DONE));
+	
+	// An event the message does not wait for is ignored
+	assert(!i2c_a78_events_complete(I2C_A78_EVENT_CTRL_DONE, 0, I2C_A78_EVENT_DMA_DONE));
+	
+	printf("✓ Completion event mask test passed\n");
+	return 0;
+}
+
+static int test_dma_threshold_calibration(void)
+{
+	const u16 lens[] = { 8, 16, 24, 32, 48, 64 };
+	const s64 pio_1mhz[] = { 90, 180, 270, 360, 540, 720 };
+	const s64 dma_1mhz[] = { 150, 170, 200, 230, 290, 350 };
+	const s64 pio_100k[] = { 900, 1800, 2700, 3600, 5400, 7200 };
+	const s64 dma_100k[] = { 950, 1850, 2760, 3650, 5420, 7210 };
+	const s64 dma_noisy[] = { 150, 170, 300, 230, 290, 350 };
+	
+	printf("Testing PIO/DMA threshold calibration...\n");
+	
+	// Fast bus: DMA setup cost is amortised early
+	assert(i2c_a78_dma_crossover(lens, pio_1mhz, dma_1mhz, 6) == 16);
+	
+	// Slow bus: wire time dominates and DMA never wins
+	assert(i2c_a78_dma_crossover(lens, pio_100k, dma_100k, 6) ==
+	       I2C_A78_DMA_THRESHOLD_OFF);
+	
+	// A single slower point raises the threshold above it
+	assert(i2c_a78_dma_crossover(lens, pio_1mhz, dma_noisy, 6) == 32);
+	
+	// The driver stops the sweep at the first slower length
+	assert(i2c_a78_dma_crossover(lens + 2, pio_1mhz + 2, dma_noisy + 2, 4) == 32);
+	
+	printf("✓ DMA threshold calibration test passed\n");
+	return 0;
+}
+
+/* The arbiter's bookkeeping around i2c_a78_dma_arb_pick() */
+static int dma_arb_take(u32 present, u32 *busy, int own)
+{
+	int idx = i2c_a78_dma_arb_pick(present & ~*busy, own);
+	
+	if (idx >= 0)
+		*busy |= BIT(idx);
+	
+	return idx;
+}
+
+static int test_dma_channel_arbitration(void)
+{
+	u32 present = BIT(0) | BIT(2);
+	u32 busy = 0;
+	
+	printf("Testing DMA channel arbitration...\n");
+	
+	// Owners get their own pair back
+	assert(dma_arb_take(present, &busy, 2) == 2);
+	assert(dma_arb_take(present, &busy, 0) == 0);
+	
+	// A borrower is starved while every pair is in use
+	assert(dma_arb_take(present, &busy, -1) == -1);
+	
+	// Once a pair is returned the borrower gets it, whoever owns it
+	busy &= ~BIT(2);
+	assert(dma_arb_take(present, &busy, -1) == 2);
+	
+	// The owner of a lent pair falls back to another idle one
+	busy &= ~BIT(0);
+	assert(dma_arb_take(present, &busy, 2) == 0);
+	assert(busy == present);
+	
+	printf("✓ DMA channel arbitration test passed\n");
+	return 0;
+}
+
+static int test_dma_bounce_pool(void)
+{
+	u32 busy = 0;
+	int i, idx;
+	
+	printf("Testing DMA bounce pool leases...\n");
+	
+	// An empty pool has nothing to lease
+	assert(i2c_a78_dma_pool_pick(0, 0) == -1);
+	
+	// Leases take the lowest free buffer until the pool is exhausted
+	for (i = 0; i < 3; i++) {
+		idx = i2c_a78_dma_pool_pick(busy, 3);
+		assert(idx == i);
+		busy |= BIT(idx);
+	}
+	assert(i2c_a78_dma_pool_pick(busy, 3) == -1);
+	
+	// A returned buffer is the next one leased
+	busy &= ~BIT(1);
+	assert(i2c_a78_dma_pool_pick(busy, 3) == 1);
+	
+	// The largest pool fills every bit of the busy mask
+	assert(i2c_a78_dma_pool_pick(U32_MAX, I2C_A78_DMA_POOL_MAX) == -1);
+	assert(i2c_a78_dma_pool_pick(U32_MAX & ~BIT(31), I2C_A78_DMA_POOL_MAX) == 31);
+	
+	printf("✓ DMA bounce pool test passed\n");
+	return 0;
+}
+
+static int test_stream_ring(void)
+{
+	unsigned int head, tail;
+	int i;
+	
+	printf("Testing streaming write segment ring...\n");
+	
+	// Writes queue without waiting until the ring is full
+	head = tail = 0;
+	for (i = 0; i < I2C_A78_STREAM_DEPTH; i++) {
+		assert(!i2c_a78_stream_full(head, tail));
+		head++;
+	}
+	assert(i2c_a78_stream_full(head, tail));
+	
+	// Retiring the oldest segment makes room for one more
+	tail++;
+	assert(!i2c_a78_stream_full(head, tail));
+	
+	// The counters are free-running and survive wrapping
+	tail = UINT32_MAX - 1;
+	head = tail + I2C_A78_STREAM_DEPTH;
+	assert(head < tail);
+	assert(i2c_a78_stream_full(head, tail));
+	assert(!i2c_a78_stream_full(head, tail + 1));
+	
+	// Each segment gets the transfer timeout plus its time on the bus
+	assert(i2c_a78_stream_seg_ms(I2C_A78_TIMEOUT_MS, 0, I2C_A78_SPEED_FAST) ==
+	       I2C_A78_TIMEOUT_MS);
+	assert(i2c_a78_stream_seg_ms(I2C_A78_TIMEOUT_MS, 1000, I2C_A78_SPEED_STD) ==
+	       I2C_A78_TIMEOUT_MS + 90);
+	
+	// Segments are not limited to the u16 length of an i2c_msg
+	assert(i2c_a78_stream_seg_ms(0, 1 << 20, I2C_A78_SPEED_FAST) == 23592);
+	
+	printf("✓ Streaming write segment ring test passed\n");
+	return 0;
+}
+
+/* What a session holds, driven as i2c_a78_session_*() and the expiry work do */
+struct session_model {
+	enum i2c_a78_session_state state;
+	int bus_locks;
+	int pm_refs;
+	int unlocks;
+};
+
+static void session_model_expire(struct session_model *m)
+{
+	if (i2c_a78_session_holds_power(m->state))
+		m->pm_refs--;
+	m->state = i2c_a78_session_expire_state(m->state);
+}
+
+static int session_model_xfer(struct session_model *m)
+{
+	if (m->state == I2C_A78_SESSION_OPEN)
+		return 0;
+	
+	if (i2c_a78_session_holds_bus(m->state)) {
+		m->bus_locks--;
+		m->unlocks++;
+	}
+	m->state = i2c_a78_session_call_state(m->state);
+	return -ETIMEDOUT;
+}
+
+static void session_model_end(struct session_model *m)
+{
+	if (i2c_a78_session_holds_power(m->state))
+		m->pm_refs--;
+	if (i2c_a78_session_holds_bus(m->state)) {
+		m->bus_locks--;
+		m->unlocks++;
+	}
+}
+
+static int test_session_expiry(void)
+{
+	struct session_model m;
+	
+	printf("Testing bus session expiry...\n");
+	
+	// Begin, transfers, end: everything is released once, at the end
+	m = (struct session_model){ I2C_A78_SESSION_OPEN, 1, 1, 0 };
+	assert(session_model_xfer(&m) == 0);
+	assert(session_model_xfer(&m) == 0);
+	session_model_end(&m);
+	assert(m.bus_locks == 0 && m.pm_refs == 0 && m.unlocks == 1);
+	
+	// Expiry drops the PM reference at once, a later expiry nothing more
+	m = (struct session_model){ I2C_A78_SESSION_OPEN, 1, 1, 0 };
+	assert(session_model_xfer(&m) == 0);
+	session_model_expire(&m);
+	assert(m.state == I2C_A78_SESSION_EXPIRED);
+	assert(m.pm_refs == 0 && m.bus_locks == 1);
+	session_model_expire(&m);
+	assert(m.pm_refs == 0);
+	
+	// The owner's next transfer fails and unlocks the bus, later ones only fail
+	assert(session_model_xfer(&m) == -ETIMEDOUT);
+	assert(m.state == I2C_A78_SESSION_CLOSED && m.bus_locks == 0);
+	assert(session_model_xfer(&m) == -ETIMEDOUT);
+	assert(m.unlocks == 1);
+	
+	// Ending a closed session releases nothing twice
+	session_model_end(&m);
+	assert(m.bus_locks == 0 && m.pm_refs == 0 && m.unlocks == 1);
+	
+	// Ending an expired session before any further call unlocks the bus
+	m = (struct session_model){ I2C_A78_SESSION_OPEN, 1, 1, 0 };
+	session_model_expire(&m);
+	session_model_end(&m);
+	assert(m.bus_locks == 0 && m.pm_refs == 0 && m.unlocks == 1);
+	
+	printf("✓ Bus session expiry test passed\n");
+	return 0;
+}
+
 static int test_address_modes(void)
 {
 	struct i2c_msg msg_7bit, msg_10bit;
@@ -260,6 +821,341 @@ static int test_register_context_save_restore(void)
 	return 0;
 }
 
+static int test_shadow_context_restore(void)
+{
+	struct i2c_a78_dev *i2c_dev;
+	unsigned int idx, writes = 0;
+	u32 mask;
+	
+	printf("Testing shadow register context restore...\n");
+	
+	i2c_dev = create_test_device();
+	mock_reset_registers();
+	
+	i2c_a78_write_ctx(i2c_dev, I2C_A78_CONTROL_MASTER_EN | I2C_A78_CONTROL_INT_EN,
+			  I2C_A78_CONTROL);
+	i2c_a78_write_ctx(i2c_dev, 0x1234, I2C_A78_PRESCALER);
+	i2c_a78_write_ctx(i2c_dev, 0x0808, I2C_A78_FIFO_THRESH);
+	i2c_a78_write_ctx(i2c_dev, 0, I2C_A78_FIFO_THRESH);
+	
+	// Writing a register back to its reset value clears its dirty bit
+	assert(i2c_dev->ctx.dirty == (BIT(I2C_A78_CONTROL / 4) | BIT(I2C_A78_PRESCALER / 4)));
+	
+	// Registers outside the context are written but not shadowed
+	i2c_a78_write_ctx(i2c_dev, I2C_A78_COMMAND_STOP, I2C_A78_COMMAND);
+	assert(!(i2c_dev->ctx.dirty & ~I2C_A78_CTX_REGS));
+	assert(i2c_a78_read_ctx(i2c_dev, I2C_A78_COMMAND) == 0);
+	
+	// Simulate power loss
+	mock_reset_registers();
+	
+	// Restore as i2c_a78_restore_context() does: dirty registers, then CONTROL
+	mask = i2c_a78_ctx_restore_mask(&i2c_dev->ctx);
+	assert(mask == BIT(I2C_A78_PRESCALER / 4));
+	for (idx = 0; idx < I2C_A78_CTX_NREGS; idx++) {
+		if (mask & BIT(idx)) {
+			i2c_a78_writel(i2c_dev, i2c_dev->ctx.regs[idx], idx * 4);
+			writes++;
+		}
+	}
+	if (i2c_dev->ctx.dirty & BIT(I2C_A78_CONTROL / 4)) {
+		i2c_a78_writel(i2c_dev, i2c_a78_read_ctx(i2c_dev, I2C_A78_CONTROL),
+			       I2C_A78_CONTROL);
+		writes++;
+	}
+	
+	assert(writes == 2);
+	assert(i2c_a78_readl(i2c_dev, I2C_A78_CONTROL) ==
+	       i2c_a78_read_ctx(i2c_dev, I2C_A78_CONTROL));
+	assert(i2c_a78_readl(i2c_dev, I2C_A78_PRESCALER) == 0x1234);
+	assert(i2c_a78_readl(i2c_dev, I2C_A78_FIFO_THRESH) == 0);
+	
+	printf("✓ Shadow register context restore test passed\n");
+	return 0;
+}
+
+static int test_adaptive_autosuspend(void)
+{
+	uint32_t gaps[I2C_A78_PM_GAP_BUCKETS] = { 0 };
+	
+	printf("Testing adaptive autosuspend delay...\n");
+	
+	// A sensor polled every 120 ms (bucket 7, 64-127 ms) keeps the bus up
+	gaps[7] = 32;
+	assert(i2c_a78_pm_best_delay(gaps, I2C_A78_PM_DELAY_MIN_MS, I2C_A78_PM_DELAY_MAX_MS,
+				     I2C_A78_PM_BREAK_EVEN_MS) == 128);
+	
+	// ...unless a resume is cheaper than 120 ms of idle power
+	assert(i2c_a78_pm_best_delay(gaps, I2C_A78_PM_DELAY_MIN_MS, I2C_A78_PM_DELAY_MAX_MS,
+				     20) == I2C_A78_PM_DELAY_MIN_MS);
+	
+	// A quiet bus suspends as early as the bounds allow
+	gaps[7] = 0;
+	gaps[13] = 32;
+	assert(i2c_a78_pm_best_delay(gaps, I2C_A78_PM_DELAY_MIN_MS, I2C_A78_PM_DELAY_MAX_MS,
+				     I2C_A78_PM_BREAK_EVEN_MS) == I2C_A78_PM_DELAY_MIN_MS);
+	
+	// Mostly short gaps with a few long ones still covers the short ones
+	gaps[4] = 32;
+	gaps[13] = 4;
+	assert(i2c_a78_pm_best_delay(gaps, I2C_A78_PM_DELAY_MIN_MS, I2C_A78_PM_DELAY_MAX_MS,
+				     I2C_A78_PM_BREAK_EVEN_MS) == 16);
+	
+	// Equal bounds pin the delay
+	assert(i2c_a78_pm_best_delay(gaps, 100, 100, I2C_A78_PM_BREAK_EVEN_MS) == 100);
+	
+	printf("✓ Adaptive autosuspend delay test passed\n");
+	return 0;
+}
+
+static int test_resume_ready_poll(void)
+{
+	struct i2c_a78_dev *i2c_dev;
+	
+	printf("Testing resume ready poll...\n");
+	
+	i2c_dev = create_test_device();
+	
+	// Clock domain still off: STATUS reads as zero
+	mock_reset_registers();
+	assert(!i2c_a78_status_ready(i2c_a78_readl(i2c_dev, I2C_A78_STATUS)));
+	
+	// Out of reset: STATUS shows RX FIFO empty, whatever else is set
+	i2c_a78_writel(i2c_dev, I2C_A78_STATUS_FIFO_RX_EMPTY, I2C_A78_STATUS);
+	assert(i2c_a78_status_ready(i2c_a78_readl(i2c_dev, I2C_A78_STATUS)));
+	assert(i2c_a78_status_ready(I2C_A78_STATUS_FIFO_RX_EMPTY | I2C_A78_STATUS_BUSY));
+	assert(!i2c_a78_status_ready(I2C_A78_STATUS_BUSY));
+	
+	printf("✓ Resume ready poll test passed\n");
+	return 0;
+}
+
+static int test_pm_qos_hold(void)
+{
+	printf("Testing PM QoS resume latency hold...\n");
+	
+	// No constraint never holds the controller up
+	assert(!i2c_a78_pm_qos_hold(PM_QOS_RESUME_LATENCY_NO_CONSTRAINT, 0));
+	assert(!i2c_a78_pm_qos_hold(PM_QOS_RESUME_LATENCY_NO_CONSTRAINT, 5000));
+	
+	// Before the first resume the datasheet figure is the cost
+	assert(i2c_a78_pm_resume_cost(0) == I2C_A78_PM_RESUME_COST_US);
+	assert(i2c_a78_pm_qos_hold(50, 0));
+	assert(!i2c_a78_pm_qos_hold(200, 0));
+	
+	// A measured fast resume lets a 50 us client tolerate suspend
+	assert(!i2c_a78_pm_qos_hold(50, 30));
+	
+	// A slow resume, or a zero tolerance, keeps it up
+	assert(i2c_a78_pm_qos_hold(50, 80));
+	assert(i2c_a78_pm_qos_hold(0, 1));
+	
+	printf("✓ PM QoS resume latency hold test passed\n");
+	return 0;
+}
+
+/*
+ * Reference accounting around the hint transitions: the hint holds a
+ * reference exactly while resumed, and a transfer takes it over.
+ */
+struct hint_model {
+	enum i2c_a78_hint_state state;
+	int usage;
+	unsigned int hits, early, misses;
+};
+
+static void hint_timer_fire(struct hint_model *h)
+{
+	enum i2c_a78_hint_state old = h->state;
+	
+	h->state = i2c_a78_hint_fire(old);
+	if (old == I2C_A78_HINT_RESUMED)
+		h->misses++;
+	h->usage += (h->state == I2C_A78_HINT_RESUMED) - (old == I2C_A78_HINT_RESUMED);
+}
+
+static void hint_arm(struct hint_model *h)
+{
+	h->state = i2c_a78_hint_arm(h->state);
+}
+
+static void hint_transfer(struct hint_model *h)
+{
+	if (h->state == I2C_A78_HINT_RESUMED) {
+		h->hits++;
+		h->usage--;
+	} else if (h->state == I2C_A78_HINT_ARMED) {
+		h->early++;
+	}
+	h->state = I2C_A78_HINT_IDLE;
+}
+
+static int test_pm_resume_hint(void)
+{
+	struct hint_model h = { I2C_A78_HINT_IDLE, 0, 0, 0, 0 };
+	
+	printf("Testing resume hints...\n");
+	
+	// Resumed ahead of time, the transfer takes over
+	hint_arm(&h);
+	assert(h.state == I2C_A78_HINT_ARMED);
+	hint_timer_fire(&h);
+	assert(h.state == I2C_A78_HINT_RESUMED && h.usage == 1);
+	hint_transfer(&h);
+	assert(h.hits == 1 && h.usage == 0 && h.state == I2C_A78_HINT_IDLE);
+	
+	// A transfer ahead of the resume point cancels the hint
+	hint_arm(&h);
+	hint_transfer(&h);
+	assert(h.early == 1 && h.usage == 0);
+	
+	// A second hint while resumed keeps the controller up
+	hint_arm(&h);
+	hint_timer_fire(&h);
+	hint_arm(&h);
+	assert(h.state == I2C_A78_HINT_RESUMED && h.usage == 1);
+	
+	// Nothing comes: the reference is dropped at the end of the window
+	hint_timer_fire(&h);
+	assert(h.misses == 1 && h.usage == 0 && h.state == I2C_A78_HINT_IDLE);
+	
+	// A late timer after the transfer changes nothing
+	hint_timer_fire(&h);
+	assert(h.usage == 0 && h.misses == 1);
+	
+	printf("✓ Resume hint test passed\n");
+	return 0;
+}
+
+struct scl_board {
+	uint32_t rise_ns, fall_ns, hold_ns, bus_free_ns;
+};
+
+static uint32_t scl_prescaler(uint32_t bus_freq, unsigned long clk_rate,
+			      const struct scl_board *b, uint32_t *actual)
+{
+	struct i2c_timings t = {
+		.bus_freq_hz = bus_freq,
+		.scl_rise_ns = b->rise_ns,
+		.scl_fall_ns = b->fall_ns,
+		.sda_fall_ns = b->fall_ns,
+		.sda_hold_ns = b->hold_ns,
+	};
+	uint32_t prescaler;
+	
+	if (i2c_a78_scl_calc(&t, b->bus_free_ns, clk_rate, &prescaler, actual))
+		return 0;
+	
+	return prescaler;
+}
+
+/* The POST_RATE_CHANGE update of i2c_a78_clk_notify() with default edges */
+static void clk_retune(struct i2c_a78_dev *i2c_dev, unsigned long clk_rate)
+{
+	const struct i2c_a78_scl_spec *spec = i2c_a78_scl_spec(i2c_dev->bus_freq);
+	const struct scl_board edges = { spec->rise_ns, spec->fall_ns, 0, spec->buf_ns };
+	uint32_t prescaler, actual;
+	
+	prescaler = scl_prescaler(i2c_dev->bus_freq, clk_rate, &edges, &actual);
+	
+	/* A stopped clock keeps the old value */
+	if (!prescaler)
+		return;
+	
+	if (i2c_dev->suspended)
+		i2c_a78_set_ctx(i2c_dev, prescaler, I2C_A78_PRESCALER);
+	else
+		i2c_a78_write_ctx(i2c_dev, prescaler, I2C_A78_PRESCALER);
+}
+
+static int test_prescaler_retune(void)
+{
+	struct i2c_a78_dev *i2c_dev;
+	
+	printf("Testing prescaler retune on clock rate change...\n");
+	
+	i2c_dev = create_test_device();
+	i2c_dev->bus_freq = I2C_A78_SPEED_FAST;
+	i2c_dev->suspended = false;
+	mock_reset_registers();
+	
+	// Active: the register follows the new rate at once (HIGH 60, LOW 130)
+	clk_retune(i2c_dev, 100000000);
+	assert(i2c_a78_readl(i2c_dev, I2C_A78_PRESCALER) == ((60 << 16) | 130));
+	clk_retune(i2c_dev, 200000000);
+	assert(i2c_a78_readl(i2c_dev, I2C_A78_PRESCALER) == ((120 << 16) | 260));
+	
+	// Suspended: only the shadow changes, for resume to program
+	i2c_dev->suspended = true;
+	clk_retune(i2c_dev, 24000000);
+	assert(i2c_a78_readl(i2c_dev, I2C_A78_PRESCALER) == ((120 << 16) | 260));
+	assert(i2c_a78_read_ctx(i2c_dev, I2C_A78_PRESCALER) == ((15 << 16) | 32));
+	
+	// Too slow for the bus: the minimums, never a wrapped count
+	clk_retune(i2c_dev, 1000000);
+	assert(i2c_a78_read_ctx(i2c_dev, I2C_A78_PRESCALER) == ((1 << 16) | 2));
+	
+	// A stopped clock has nothing to count; the last value stays
+	clk_retune(i2c_dev, 0);
+	assert(i2c_a78_read_ctx(i2c_dev, I2C_A78_PRESCALER) == ((1 << 16) | 2));
+	
+	printf("✓ Prescaler retune test passed\n");
+	return 0;
+}
+
+static int test_scl_timing(void)
+{
+	static const uint32_t freqs[] = {
+		I2C_A78_SPEED_STD, I2C_A78_SPEED_FAST, I2C_A78_SPEED_FAST_PLUS,
+	};
+	const struct scl_board std = { 1000, 300, 0, 4700 };
+	const struct scl_board sharp = { 100, 50, 0, 0 };
+	const struct scl_board long_hold = { 100, 50, 1500, 0 };
+	const struct scl_board long_free = { 100, 50, 0, 1600 };
+	unsigned long rate;
+	uint32_t p, actual;
+	int i;
+	
+	printf("Testing SCL HIGH/LOW computation...\n");
+	
+	// Worst-case edges use the whole period for the minimums
+	p = scl_prescaler(I2C_A78_SPEED_STD, 100000000, &std, &actual);
+	assert(p == ((400 << 16) | 470));
+	assert(actual == I2C_A78_SPEED_STD);
+	
+	// Fast edges leave time over, shared without exceeding 400 kHz
+	p = scl_prescaler(I2C_A78_SPEED_FAST, 100000000, &sharp, &actual);
+	assert(p >> I2C_A78_PRESCALER_HIGH_SHIFT >= 60);
+	assert((p & I2C_A78_PRESCALER_LOW_MASK) >= 130);
+	assert(actual <= I2C_A78_SPEED_FAST && actual > I2C_A78_SPEED_FAST * 99 / 100);
+	
+	// A long SDA hold stretches LOW, not the period
+	p = scl_prescaler(I2C_A78_SPEED_FAST, 100000000, &long_hold, &actual);
+	assert((p & I2C_A78_PRESCALER_LOW_MASK) >= 165);
+	assert(actual <= I2C_A78_SPEED_FAST && actual > I2C_A78_SPEED_FAST * 99 / 100);
+	
+	// So does a bus-free time longer than tLOW
+	p = scl_prescaler(I2C_A78_SPEED_FAST, 100000000, &long_free, &actual);
+	assert((p & I2C_A78_PRESCALER_LOW_MASK) >= 160);
+	assert(actual <= I2C_A78_SPEED_FAST && actual > I2C_A78_SPEED_FAST * 99 / 100);
+	
+	// No input clock, no value
+	assert(scl_prescaler(I2C_A78_SPEED_FAST, 0, &sharp, &actual) == 0);
+	
+	// Never above nominal, within 3% once the input clock is fast enough
+	for (i = 0; i < 3; i++) {
+		for (rate = 24000000; rate <= 400000000; rate *= 2) {
+			scl_prescaler(freqs[i], rate, &sharp, &actual);
+			assert(actual <= freqs[i]);
+			if (rate >= 48000000)
+				assert(actual >= freqs[i] * 97 / 100);
+		}
+	}
+	
+	printf("✓ SCL HIGH/LOW computation test passed\n");
+	return 0;
+}
+
 struct test_case {
 	const char *name;
 	int (*test_func)(void);
@@ -269,11 +1165,31 @@ static struct test_case test_cases[] = {
 	{"DMA Initialization", test_dma_initialization},
 	{"Message Structure", test_message_structure},
 	{"DMA Threshold", test_dma_threshold},
+	{"DMA Large Message Chunking", test_dma_large_message_chunking},
+	{"DMA Pipelined Slots", test_dma_pipelined_slots},
+	{"DMA Body/Tail Split", test_dma_burst_split},
+	{"DMA Descriptor Cache Keys", test_dma_desc_cache_keys},
+	{"DMA Polled Completion Cut-off", test_dma_poll_fits},
+	{"DMA Scatter-Gather Batching", test_dma_sg_batching},
+	{"DMA Scatter-Gather Sequencing", test_dma_sg_sequencing},
+	{"Completion Events", test_completion_events},
+	{"DMA Threshold Calibration", test_dma_threshold_calibration},
+	{"DMA Channel Arbitration", test_dma_channel_arbitration},
+	{"DMA Bounce Pool", test_dma_bounce_pool},
+	{"Stream Segment Ring", test_stream_ring},
+	{"Session Expiry", test_session_expiry},
 	{"Address Modes", test_address_modes},
 	{"Transfer Directions", test_transfer_directions},
 	{"Error Conditions", test_error_conditions},
 	{"Power Management Integration", test_power_management_integration},
 	{"Register Context Save/Restore", test_register_context_save_restore},
+	{"Shadow Context Restore", test_shadow_context_restore},
+	{"Adaptive Autosuspend Delay", test_adaptive_autosuspend},
+	{"Resume Ready Poll", test_resume_ready_poll},
+	{"PM QoS Resume Latency Hold", test_pm_qos_hold},
+	{"PM Resume Hint", test_pm_resume_hint},
+	{"Prescaler Retune", test_prescaler_retune},
+	{"SCL Timing", test_scl_timing},
 	{NULL, NULL}
 };
 
@@ -12,8 +12,27 @@
 #define GFP_ATOMIC 1
 #define PAGE_SIZE 4096
 #define BIT(nr) (1UL << (nr))
+#define GENMASK(h, l) (((~0UL) << (l)) & (~0UL >> (sizeof(long) * 8 - 1 - (h))))
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+#define U32_MAX UINT32_MAX
+#define U64_MAX UINT64_MAX
+#define S64_MAX INT64_MAX
+#define NSEC_PER_SEC 1000000000L
+#define MSEC_PER_SEC 1000L
+#define NSEC_PER_USEC 1000L
+
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define DIV_ROUND_UP_ULL(ll, d) DIV_ROUND_UP((unsigned long long)(ll), (d))
+#define min_t(type, x, y) ((type)(x) < (type)(y) ? (type)(x) : (type)(y))
+#define max_t(type, x, y) ((type)(x) > (type)(y) ? (type)(x) : (type)(y))
+#define clamp_t(type, val, lo, hi) min_t(type, max_t(type, val, lo), hi)
+
+#define ffz(x) ((unsigned long)__builtin_ctzl(~(unsigned long)(x)))
+#define __ffs(x) ((unsigned long)__builtin_ctzl(x))
+
+#define PM_QOS_RESUME_LATENCY_NO_CONSTRAINT INT32_MAX
+
 #define IRQF_SHARED 0x00000080
 #define IRQ_HANDLED 1
 
@@ -21,6 +40,8 @@ typedef uint32_t u32;
 typedef uint16_t u16;
 typedef uint8_t u8;
 typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
 typedef uint32_t dma_addr_t;
 typedef int32_t dma_cookie_t;
 typedef unsigned long ulong;
@@ -86,6 +107,17 @@ struct i2c_msg {
 	u8 *buf;
 };
 
+struct i2c_timings {
+	u32 bus_freq_hz;
+	u32 scl_rise_ns;
+	u32 scl_fall_ns;
+	u32 scl_int_delay_ns;
+	u32 sda_fall_ns;
+	u32 sda_hold_ns;
+	u32 digital_filter_width_ns;
+	u32 analog_filter_cutoff_freq_hz;
+};
+
 struct i2c_adapter {
 	struct module *owner;
 	unsigned int class;
@@ -197,4 +229,14 @@ int dmaengine_terminate_all(struct dma_chan *chan);
 void *dma_alloc_coherent(struct device *dev, size_t size, dma_addr_t *dma_handle, int flag);
 void dma_free_coherent(struct device *dev, size_t size, void *cpu_addr, dma_addr_t dma_handle);
 
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
 #endif /* __MOCK_LINUX_KERNEL_H__ */
\ No newline at end of file
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 199309L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -284,6 +285,87 @@ static benchmark_result_t benchmark_power_management(void)
     return result;
 }
 
+/*
+ * Clock framework model: prepare sleeps for PLL lock or regulator ramp,
+ * enable only flips a gate bit.
+ */
+#define CLK_MODEL_PREPARE_US 20
+
+static void clk_model_prepare(void)
+{
+    struct timespec lock_time = { 0, CLK_MODEL_PREPARE_US * 1000L };
+    nanosleep(&lock_time, NULL);
+}
+
+static void clk_model_enable(struct i2c_a78_dev *i2c_dev)
+{
+    i2c_a78_writel(i2c_dev, I2C_A78_STATUS_FIFO_RX_EMPTY, I2C_A78_STATUS);
+}
+
+/* Runtime resume: clock, ready poll, dirty context restore */
+static double runtime_resume_model(struct i2c_a78_dev *i2c_dev, bool keep_prepared)
+{
+    double start_time = get_time_us();
+    
+    if (!keep_prepared)
+        clk_model_prepare();
+    clk_model_enable(i2c_dev);
+    
+    while (!(i2c_a78_readl(i2c_dev, I2C_A78_STATUS) & I2C_A78_STATUS_FIFO_RX_EMPTY))
+        ;
+    
+    i2c_a78_writel(i2c_dev, 0x1234, I2C_A78_PRESCALER);
+    i2c_a78_writel(i2c_dev, I2C_A78_CONTROL_MASTER_EN | I2C_A78_CONTROL_INT_EN,
+                   I2C_A78_CONTROL);
+    
+    return get_time_us() - start_time;
+}
+
+static benchmark_result_t benchmark_resume_clock_modes(void)
+{
+    struct i2c_a78_dev *i2c_dev;
+    benchmark_result_t result = {0};
+    double min_time = 1e9, max_time = 0, total_time = 0;
+    double unprepare_total = 0, elapsed;
+    int iterations = BENCHMARK_ITERATIONS / 100; // Each full resume sleeps in prepare
+    
+    result.name = "Resume Clock Gate-Only";
+    result.iterations = iterations;
+    
+    printf("Benchmarking runtime resume with and without clock unprepare...\n");
+    
+    i2c_dev = create_benchmark_device();
+    
+    for (int i = 0; i < iterations; i++) {
+        // Default mode: the clock was unprepared on suspend
+        mock_reset_registers();
+        unprepare_total += runtime_resume_model(i2c_dev, false);
+        
+        // arm,keep-clock-prepared: only the gate is opened
+        mock_reset_registers();
+        elapsed = runtime_resume_model(i2c_dev, true);
+        
+        if (elapsed < min_time) min_time = elapsed;
+        if (elapsed > max_time) max_time = elapsed;
+        total_time += elapsed;
+    }
+    
+    result.min_time = min_time;
+    result.max_time = max_time;
+    result.avg_time = total_time / iterations;
+    result.total_time = total_time;
+    result.failures = 0;
+    
+    printf("Runtime resume: %.2f us with prepare, %.2f us gate-only\n",
+           unprepare_total / iterations, total_time / iterations);
+    assert(total_time < unprepare_total);
+    
+    // Calculate resumes per second
+    result.throughput_mbps = (iterations * 1000000.0) / total_time;
+    
+    return result;
+}
+
 static benchmark_result_t benchmark_interrupt_handling(void)
 {
     struct i2c_a78_dev *i2c_dev;
@@ -403,7 +485,7 @@ int main(void)
     
     clock_t total_start = clock();
     
-    benchmark_result_t results[5];
+    benchmark_result_t results[6];
     int result_count = 0;
     
     // Run benchmarks
@@ -411,6 +493,7 @@ int main(void)
     results[result_count++] = benchmark_small_transfers();
     results[result_count++] = benchmark_large_transfers();
     results[result_count++] = benchmark_power_management();
+    results[result_count++] = benchmark_resume_clock_modes();
     results[result_count++] = benchmark_interrupt_handling();
     
     clock_t total_end = clock();
@@ -13,6 +13,7 @@
 #define I2C_A78_FIFO_STATUS	0x14
 #define I2C_A78_INTERRUPT	0x18
 #define I2C_A78_PRESCALER	0x1C
+#define I2C_A78_FIFO_THRESH	0x20
 
 #define I2C_A78_CONTROL_MASTER_EN	BIT(0)
 #define I2C_A78_CONTROL_SPEED_STD	(0 << 1)
@@ -58,10 +59,38 @@
 #define I2C_A78_INT_FIFO_TX_EMPTY	BIT(5)
 #define I2C_A78_INT_FIFO_RX_FULL	BIT(6)
 
+#define I2C_A78_PRESCALER_LOW_MASK	0xFFFF
+#define I2C_A78_PRESCALER_HIGH_MASK	0xFFFF0000
+#define I2C_A78_PRESCALER_HIGH_SHIFT	16
+
 #define I2C_A78_FIFO_SIZE		16
 #define I2C_A78_DMA_THRESHOLD		32
+#define I2C_A78_DMA_BURST		8
+#define I2C_A78_FIFO_THRESH_TX_MASK	0x7F
+#define I2C_A78_FIFO_THRESH_RX_MASK	(0x7F << 8)
+#define I2C_A78_FIFO_THRESH_RX_SHIFT	8
+#define I2C_A78_DMA_SLOTS		2
+#define I2C_A78_DMA_MAX_SEGS		16
+#define I2C_A78_DMA_DESC_CACHE_SIZE	4
+#define I2C_A78_DMA_IDLE_MS		1000
+#define I2C_A78_DMA_BUF_MAX		65536
+#define I2C_A78_DMA_THRESHOLD_OFF	0x10000
+#define I2C_A78_DMA_POOL_MAX		32
+#define I2C_A78_DMA_POLL_US		100
+#define I2C_A78_DMA_ARB_MAX		32
+#define I2C_A78_STREAM_DEPTH		4
 #define I2C_A78_TIMEOUT_MS		1000
 #define I2C_A78_PM_SUSPEND_DELAY_MS	100
+#define I2C_A78_PM_DELAY_MIN_MS		10
+#define I2C_A78_PM_DELAY_MAX_MS		2000
+#define I2C_A78_PM_BREAK_EVEN_MS	200
+#define I2C_A78_PM_GAP_BUCKETS		16
+#define I2C_A78_PM_BATCH_MS		2
+#define I2C_A78_PM_READY_TIMEOUT_US	50
+#define I2C_A78_PM_RESUME_COST_US	100
+
+#define I2C_A78_EVENT_CTRL_DONE		BIT(0)
+#define I2C_A78_EVENT_DMA_DONE		BIT(1)
 
 enum i2c_a78_speed {
 	I2C_A78_SPEED_STD = 100000,
@@ -70,6 +99,8 @@ enum i2c_a78_speed {
 	I2C_A78_SPEED_HIGH = 3400000,
 };
 
+#include "../src/include/i2c-a78-calc.h"
+
 enum i2c_a78_state {
 	I2C_A78_STATE_IDLE,
 	I2C_A78_STATE_START,
@@ -82,10 +113,9 @@ enum i2c_a78_state {
 struct i2c_a78_dma_data {
 	struct dma_chan *tx_chan;
 	struct dma_chan *rx_chan;
-	dma_addr_t tx_dma_buf;
-	dma_addr_t rx_dma_buf;
-	void *tx_buf;
-	void *rx_buf;
+	dma_addr_t dma_buf;
+	void *buf;
+	size_t buf_size;
 	size_t buf_len;
 	struct completion tx_complete;
 	struct completion rx_complete;
@@ -102,10 +132,12 @@ struct i2c_a78_dev {
 	struct i2c_msg *msgs;
 	int num_msgs;
 	int msg_idx;
+	int batch_end;
 	
 	enum i2c_a78_state state;
 	u32 bus_freq;
 	u32 timeout_ms;
+	u32 dma_poll_us;
 	
 	spinlock_t lock;
 	struct completion msg_complete;
@@ -115,6 +147,7 @@ struct i2c_a78_dev {
 	bool suspended;
 	u32 saved_control;
 	u32 saved_prescaler;
+	struct i2c_a78_ctx ctx;
 	
 	struct {
 		u64 tx_bytes;
@@ -122,6 +155,26 @@ struct i2c_a78_dev {
 		u32 timeouts;
 		u32 arb_lost;
 		u32 nacks;
+		u32 dma_batches;
+		u32 dma_zero_copy;
+		u32 dma_bounced;
+		u64 dma_desc_hits;
+		u64 dma_desc_misses;
+		u32 dma_issued_ahead;
+		u32 dma_acquires;
+		u32 dma_acquire_us;
+		u32 dma_acquire_max_us;
+		u32 dma_releases;
+		u32 dma_chan_borrows;
+		u32 dma_chan_waits;
+		u64 dma_chan_wait_us;
+		u32 dma_chan_wait_max_us;
+		u32 dma_chan_starved;
+		u32 streams;
+		u32 stream_aborts;
+		u32 dma_polled;
+		u32 dma_poll_sleeps;
+		u32 pm_fast_gets;
 	} stats;
 };
 
@@ -135,6 +188,22 @@ static inline void i2c_a78_writel(struct i2c_a78_dev *i2c_dev, u32 value, u32 of
 	mock_writel(value, i2c_dev->base + offset);
 }
 
+static inline void i2c_a78_set_ctx(struct i2c_a78_dev *i2c_dev, u32 value, u32 offset)
+{
+	i2c_a78_ctx_set(&i2c_dev->ctx, value, offset);
+}
+
+static inline void i2c_a78_write_ctx(struct i2c_a78_dev *i2c_dev, u32 value, u32 offset)
+{
+	i2c_a78_set_ctx(i2c_dev, value, offset);
+	i2c_a78_writel(i2c_dev, value, offset);
+}
+
+static inline u32 i2c_a78_read_ctx(struct i2c_a78_dev *i2c_dev, u32 offset)
+{
+	return i2c_dev->ctx.regs[offset / 4];
+}
+
 int i2c_a78_dma_init(struct i2c_a78_dev *i2c_dev);
 void i2c_a78_dma_release(struct i2c_a78_dev *i2c_dev);
 int i2c_a78_dma_xfer(struct i2c_a78_dev *i2c_dev, struct i2c_msg *msg);